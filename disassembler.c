@@ -8,32 +8,84 @@
 #include <errno.h>
 #include <string.h>
 #include "printRoutines.h"
+#include "searchRoutines.h"
+#include "profileRoutines.h"
+#include "lintRoutines.h"
+#include "traceRoutines.h"
+#include "ysRoutines.h"
+#include "imageRoutines.h"
 
 #define ERROR_RETURN -1
 #define SUCCESS 0
 
-inst_t fetch_instruction(FILE* inputStream, long currAddr, FILE* out);
-long get_addr_of_next_non_zero_byte (FILE* inputStream, long currAddr, long file_length);
+typedef enum output_mode {
+  LISTING, SEARCH, SUMMARY, LINT, LINT_REPORT, YS
+} output_mode_t;
+
+inst_t fetch_instruction(image_t* image, y86_addr_t currAddr);
+inst_t truncate_to_data (inst_t inst, int size);
+void print_usage (char* progName);
 
 
 int main(int argc, char **argv) {
   
-  FILE *machineCode, *outputFile;
-  long currAddr = 0; // current reading position of a file
+  image_t machineCode;
+  FILE *outputFile;
+  y86_addr_t currAddr = 0; // current reading position of a file
+  output_mode_t mode = LISTING;
+  char *patternFilename = NULL;
+  searcher_t searcher;
+  profile_t profile;
+  linter_t linter;
+  char *traceFilename = NULL;
+  trace_t trace;
+  hot_blocks_t hot_blocks;
+  ys_writer_t ys;
+  int res = SUCCESS;
+  char *progName = argv[0];
+
+  // Options come before the positional arguments, drop them from argv
+  // so that the positional arguments keep their usual indices
+  int argi = 1;
+  while (argi < argc && strncmp(argv[argi], "--", 2) == 0) {
+    if (strcmp(argv[argi], "--search") == 0 && argi + 1 < argc && mode == LISTING) {
+      mode = SEARCH;
+      patternFilename = argv[argi + 1];
+      argi += 2;
+    } else if (strcmp(argv[argi], "--trace") == 0 && argi + 1 < argc && traceFilename == NULL) {
+      traceFilename = argv[argi + 1];
+      argi += 2;
+    } else if (strcmp(argv[argi], "--summary") == 0 && mode == LISTING) {
+      mode = SUMMARY;
+      argi += 1;
+    } else if (strcmp(argv[argi], "--lint") == 0 && mode == LISTING) {
+      mode = LINT;
+      argi += 1;
+    } else if (strcmp(argv[argi], "--lint-report") == 0 && mode == LISTING) {
+      mode = LINT_REPORT;
+      argi += 1;
+    } else if (strcmp(argv[argi], "--ys") == 0 && mode == LISTING) {
+      mode = YS;
+      argi += 1;
+    } else {
+      print_usage(progName);
+      return ERROR_RETURN;
+    }
+  }
+  argc -= argi - 1;
+  argv += argi - 1;
 
   // Verify that the command line has an appropriate number
   // of arguments
 
   if (argc < 3 || argc > 4) {
-    printf("Usage: %s InputFilename OutputFilename [startingOffset]\n", argv[0]);
+    print_usage(progName);
     return ERROR_RETURN;
   }
 
   // First argument is the file to read, attempt to open it 
   // for reading and verify that the open did occur.
-  machineCode = fopen(argv[1], "rb"); // r for read, b for binary
-
-  if (machineCode == NULL) {
+  if (open_image(&machineCode, argv[1]) != 0) {
     printf("Failed to open %s: %s\n", argv[1], strerror(errno));
     return ERROR_RETURN;
   }
@@ -44,19 +96,19 @@ int main(int argc, char **argv) {
 
   if (outputFile == NULL) {
     printf("Failed to open %s: %s\n", argv[2], strerror(errno));
-    fclose(machineCode);
+    close_image(&machineCode);
     return ERROR_RETURN;
   }
 
   // If there is a 3rd argument present it is an offset so
   // convert it to a value. 
   if (4 == argc) {
-    // See man page for strtol() as to why we check for errors by examining errno
+    // See man page for strtoull() as to why we check for errors by examining errno
     errno = 0;
-    currAddr = strtol(argv[3], NULL, 0);
+    currAddr = strtoull(argv[3], NULL, 0);
     if (errno != 0) {
       perror("Invalid offset on command line");
-      fclose(machineCode);
+      close_image(&machineCode);
       fclose(outputFile);
       return ERROR_RETURN;
     }
@@ -65,48 +117,213 @@ int main(int argc, char **argv) {
   printf("Opened %s, starting offset 0x%lX\n", argv[1], currAddr);
   printf("Saving output to %s\n", argv[2]);
 
+  // In search mode, compile the patterns instead of printing the listing
+  if (mode == SEARCH) {
+    FILE *patternFile = fopen(patternFilename, "r");
+    if (patternFile == NULL) {
+      printf("Failed to open %s: %s\n", patternFilename, strerror(errno));
+      close_image(&machineCode);
+      fclose(outputFile);
+      return ERROR_RETURN;
+    }
+    int res = load_search_patterns(&searcher, patternFile);
+    fclose(patternFile);
+    if (res != 0) {
+      free_searcher(&searcher);
+      close_image(&machineCode);
+      fclose(outputFile);
+      return ERROR_RETURN;
+    }
+    printf("Searching for %d patterns\n", searcher.num_of_patterns);
+  }
+
+  // With a trace, executed addresses guide the decoding and annotate the listing
+  if (traceFilename != NULL) {
+    FILE *traceFile = fopen(traceFilename, "r");
+    if (traceFile == NULL) {
+      printf("Failed to open %s: %s\n", traceFilename, strerror(errno));
+      if (mode == SEARCH) free_searcher(&searcher);
+      close_image(&machineCode);
+      fclose(outputFile);
+      return ERROR_RETURN;
+    }
+    int res = load_trace(&trace, traceFile);
+    fclose(traceFile);
+    if (res != 0) {
+      free_trace(&trace);
+      if (mode == SEARCH) free_searcher(&searcher);
+      close_image(&machineCode);
+      fclose(outputFile);
+      return ERROR_RETURN;
+    }
+  }
+
   // Your code starts here.
 
-  fseek(machineCode, 0, SEEK_END); // seek to end of file
-  long file_length = ftell(machineCode); // get current file position (i.e. total number of bytes in the file) 
-  fseek(machineCode, 0, SEEK_SET); // seek back to beginning of file
+  y86_addr_t file_length = machineCode.length; // total number of bytes in the file
 
-  // move the file reading postion to the first non-zero byte in machineCode
-  currAddr = get_addr_of_next_non_zero_byte(machineCode, currAddr, file_length);
-  fseek(machineCode, currAddr, SEEK_SET);
+  if (mode == SUMMARY) {
+    init_profile(&profile);
+  } else if (mode == LINT || mode == LINT_REPORT) {
+    init_linter(&linter, mode == LINT);
+  } else if (mode == YS) {
+    init_ys_writer(&ys);
+  }
+
+  if (traceFilename != NULL) {
+    init_hot_blocks(&hot_blocks);
+  }
 
   // start disassembing
   inst_t inst;
+  long count = 0;        // execution count of current instruction, if there is a trace
+  long num_of_conflicts = 0;          // executed instructions overlapping a later executed address
+  y86_addr_t first_conflict = 0;
+  int at_zero_fill = 1;  // zero bytes at the starting offset and after a halt are skipped
   while(currAddr < file_length){
-    inst = fetch_instruction(machineCode, currAddr, outputFile);
-    if (inst.type != INVALID) {
-      print_assembly(inst, currAddr, outputFile);
+    if (at_zero_fill){
+      // move the file reading postion to the next non-zero byte, but never past a traced pc
+      y86_addr_t nextAddr = find_next_non_zero_byte(&machineCode, currAddr);
+      if (machineCode.error != 0) break;
+      if (traceFilename != NULL) {
+        trace_skip_to(&trace, currAddr);
+        if (trace.has_current && trace.current.pc < nextAddr) {
+          nextAddr = trace.current.pc;
+        }
+      }
+      if (mode == SUMMARY) {
+        profile_zero_fill(&profile, currAddr, nextAddr);
+      }
+      currAddr = nextAddr;
+      if (currAddr >= file_length) break;
+    }
+
+    inst = fetch_instruction(&machineCode, currAddr);
+    if (machineCode.error != 0) break;
+
+    if (traceFilename != NULL) {
+      // executed addresses are confirmed instruction starts: if one falls inside the
+      // instruction just decoded, its bytes up to the executed address are data, even
+      // if currAddr was executed too (the two executed instructions overlap)
+      trace_skip_to(&trace, currAddr);
+      count = 0;
+      if (trace.has_current && trace.current.pc == currAddr) {
+        count = trace.current.count;
+        trace_skip_to(&trace, currAddr + 1);
+        if (trace.has_current && trace.current.pc < currAddr + inst.size) {
+          if (num_of_conflicts++ == 0) {
+            first_conflict = currAddr;
+          }
+        }
+      }
+      if (trace.has_current && trace.current.pc < currAddr + inst.size) {
+        inst = truncate_to_data(inst, trace.current.pc - currAddr);
+      }
+      hot_blocks_feed(&hot_blocks, inst, currAddr, count);
+    }
+
+    switch (mode) {
+      case SEARCH:
+          search_feed(&searcher, inst, currAddr);
+          break;
+      case SUMMARY:
+          profile_inst(&profile, inst, currAddr);
+          break;
+      case LINT_REPORT:
+          lint_feed(&linter, inst, currAddr, outputFile);
+          break;
+      case YS:
+          ys_emit(&ys, inst, currAddr, outputFile);
+          break;
+      default:
+          if (inst.type == INVALID) {
+            print_data(inst, currAddr, outputFile);
+          } else if (traceFilename != NULL) {
+            int len = print_assembly_line(inst, currAddr, outputFile);
+            fprintf(outputFile, "%*s# %ld\n", len < TRACE_COUNT_COLUMN ? TRACE_COUNT_COLUMN - len : 1, "", count);
+          } else {
+            print_assembly(inst, currAddr, outputFile);
+          }
+          if (mode == LINT) {
+            lint_feed(&linter, inst, currAddr, outputFile);
+          }
+          break;
     }
+
     currAddr += inst.size;
+    at_zero_fill = inst.type == HALT;
+  }
 
-    if (inst.type == HALT){
-      // move the file reading postion to the next non-zero byte
-      currAddr = get_addr_of_next_non_zero_byte(machineCode, currAddr, file_length);
-      fseek(machineCode, currAddr, SEEK_SET);      
+  // a failed read is not the end of the input, the output so far is incomplete
+  if (machineCode.error != 0) {
+    printf("Failed to read %s at 0x%lX: %s\n", argv[1], currAddr, strerror(machineCode.error));
+    if (mode == SEARCH) free_searcher(&searcher);
+    if (mode == YS) free_ys_writer(&ys);
+    if (traceFilename != NULL) free_trace(&trace);
+    close_image(&machineCode);
+    fclose(outputFile);
+    return ERROR_RETURN;
+  }
+
+  if (mode == SEARCH) {
+    print_search_matches(&searcher, outputFile);
+    printf("Found %ld matches\n", searcher.num_of_matches);
+    free_searcher(&searcher);
+  } else if (mode == SUMMARY) {
+    print_profile(&profile, outputFile);
+  } else if (mode == LINT || mode == LINT_REPORT) {
+    print_lint_totals(&linter, outputFile);
+  } else if (mode == YS) {
+    if (ys_end_emitting(&ys, outputFile) != 0) {
+      res = ERROR_RETURN;
+    }
+    printf("Round trip: %ld bytes re-encoded, %ld mismatches\n", ys.bytes_verified, ys.num_of_mismatches);
+    if (ys.num_of_mismatches > 0) {
+      printf("First mismatch at 0x%lx\n", ys.first_mismatch);
+      res = ERROR_RETURN;
+    }
+    free_ys_writer(&ys);
+  }
+
+  if (traceFilename != NULL) {
+    if (num_of_conflicts > 0) {
+      printf("%ld executed instructions overlap another executed address and are printed as data, first at 0x%lX\n",
+             num_of_conflicts, first_conflict);
+    }
+    if (mode == LISTING || mode == LINT || mode == SUMMARY) {
+      fputc('\n', outputFile);
+      print_hot_blocks(&hot_blocks, outputFile);
     }
+    free_trace(&trace);
   }
   
-  fclose(machineCode);
+  close_image(&machineCode);
   fclose(outputFile);
-  return SUCCESS;
+  return res;
+}
+
+void print_usage (char* progName){
+  printf("Usage: %s [--search PatternFilename | --summary | --lint | --lint-report | --ys] [--trace TraceFilename] InputFilename OutputFilename [startingOffset]\n", progName);
 }
 
 
 
 
-// fetch a single instruction from inputStream, eheck its invalidity, and return the instruction
-// if the instruction is invalid, print the address, memory value and assemlby of it to out file
-inst_t fetch_instruction(FILE* inputStream, long currAddr, FILE* out){
+// fetch a single instruction at currAddr from image, eheck its invalidity, and return the instruction
+// if the instruction is invalid, it is up to 8 bytes of data which are returned in imm_val
+inst_t fetch_instruction(image_t* image, y86_addr_t currAddr){
   uint8_t inst_buffer [10];
-  uint16_t num_of_bytes_fetched;
-  fread(inst_buffer, 1, 1, inputStream);
+  // fetch as many bytes as the longest instruction has, fewer only at the end of the image
+  size_t num_of_bytes_fetched = read_image(image, currAddr, inst_buffer, sizeof(inst_buffer));
   inst_t inst;
 
+  // nothing is fetched only if reading failed, the caller checks image->error
+  if (num_of_bytes_fetched == 0) {
+    inst.type = INVALID;
+    inst.size = 0;
+    return inst;
+  }
+
   switch (inst_buffer[0]) {
     case 0x00:
           inst.type = HALT;
@@ -154,10 +371,8 @@ inst_t fetch_instruction(FILE* inputStream, long currAddr, FILE* out){
             }
 
           inst.size = 2;
-          // fetch remaining bytes of current instruction and check if invalid due to EOF
-          // Note: file reading position is currently after opcode of current instruction 
-          num_of_bytes_fetched = fread(inst_buffer+1, 1, inst.size-1, inputStream);
-          if (num_of_bytes_fetched < inst.size-1){
+          // check if invalid due to EOF
+          if (num_of_bytes_fetched < inst.size){
             inst.type = INVALID;
             break;
           }
@@ -173,8 +388,7 @@ inst_t fetch_instruction(FILE* inputStream, long currAddr, FILE* out){
         inst.size = 10;
         inst.opcode = 0x30;
 
-        num_of_bytes_fetched = fread(inst_buffer+1, 1, inst.size-1, inputStream);
-        if (num_of_bytes_fetched < inst.size-1){
+        if (num_of_bytes_fetched < inst.size){
           inst.type = INVALID;
           break;
         }
@@ -191,8 +405,7 @@ inst_t fetch_instruction(FILE* inputStream, long currAddr, FILE* out){
         inst.size = 10;
         inst.opcode = 0x40;
 
-        num_of_bytes_fetched = fread(inst_buffer+1, 1, inst.size-1, inputStream);
-        if (num_of_bytes_fetched < inst.size-1){
+        if (num_of_bytes_fetched < inst.size){
           inst.type = INVALID;
           break;
         }
@@ -210,8 +423,7 @@ inst_t fetch_instruction(FILE* inputStream, long currAddr, FILE* out){
         inst.size = 10;
         inst.opcode = 0x50;
 
-        num_of_bytes_fetched = fread(inst_buffer+1, 1, inst.size-1, inputStream);
-        if (num_of_bytes_fetched < inst.size-1){
+        if (num_of_bytes_fetched < inst.size){
           inst.type = INVALID;
           break;
         }
@@ -248,8 +460,7 @@ inst_t fetch_instruction(FILE* inputStream, long currAddr, FILE* out){
         }
 
         inst.size = 2;
-        num_of_bytes_fetched = fread(inst_buffer+1, 1, inst.size-1, inputStream);
-        if (num_of_bytes_fetched < inst.size-1){
+        if (num_of_bytes_fetched < inst.size){
           inst.type = INVALID;
           break;
         }
@@ -294,8 +505,7 @@ inst_t fetch_instruction(FILE* inputStream, long currAddr, FILE* out){
                 break;
         }
         inst.size = 9;
-        num_of_bytes_fetched = fread(inst_buffer+1, 1, inst.size-1, inputStream);
-        if (num_of_bytes_fetched < inst.size-1){
+        if (num_of_bytes_fetched < inst.size){
           inst.type = INVALID;
           break;
         }
@@ -306,8 +516,7 @@ inst_t fetch_instruction(FILE* inputStream, long currAddr, FILE* out){
         inst.type = CALL;
         inst.opcode = 0x80;
         inst.size = 9;
-        num_of_bytes_fetched = fread(inst_buffer+1, 1, inst.size-1, inputStream);
-        if (num_of_bytes_fetched < inst.size-1){
+        if (num_of_bytes_fetched < inst.size){
           inst.type = INVALID;
           break;
         }
@@ -324,8 +533,7 @@ inst_t fetch_instruction(FILE* inputStream, long currAddr, FILE* out){
         inst.type = PUSHQ;
         inst.opcode = 0xa0;
         inst.size = 2;
-        num_of_bytes_fetched = fread(inst_buffer+1, 1, inst.size-1, inputStream);
-        if (num_of_bytes_fetched < inst.size-1){
+        if (num_of_bytes_fetched < inst.size){
           inst.type = INVALID;
           break;
         }
@@ -340,8 +548,7 @@ inst_t fetch_instruction(FILE* inputStream, long currAddr, FILE* out){
         inst.type = POPQ;
         inst.opcode = 0xb0;
         inst.size = 2;
-        num_of_bytes_fetched = fread(inst_buffer+1, 1, inst.size-1, inputStream);
-        if (num_of_bytes_fetched < inst.size-1){
+        if (num_of_bytes_fetched < inst.size){
           inst.type = INVALID;
           break;
         }
@@ -359,42 +566,36 @@ inst_t fetch_instruction(FILE* inputStream, long currAddr, FILE* out){
 
   // handle invalid instruction
   if (inst.type == INVALID){
-    inst.size = 8;
-    // move file reading position to the beginning of current instruction and read the next 8 bytes if available
-    fseek(inputStream, currAddr, SEEK_SET);
-    num_of_bytes_fetched = fread(inst_buffer, 1, inst.size, inputStream);
-
-    // if actual instruction is shorter than 8 bytes due to EOF, update inst_size
-    inst.size = num_of_bytes_fetched;
-
-    // print invalid instruction
-    char mem_val[8*2+1] = {0};
-    if (num_of_bytes_fetched < 8){
-      for (int i = 0; i < num_of_bytes_fetched; i++){
-        sprintf(mem_val, "%02x", (unsigned char) inst_buffer[i]);
-        fprintf(out, "%016lx: %-22s.byte %#02hhx\n", currAddr + i, mem_val, inst_buffer[i]);
-      }
-    } else {
-      for (int i = 0; i < 8; i++){
-        sprintf(mem_val+2*i, "%02x", (unsigned char) inst_buffer[i]);
-      }
-      fprintf(out, "%016lx: %-22s.quad %#lx\n", currAddr, mem_val, get_8_bytes_from_array(inst_buffer, 0, BIG_ENDIAN));
+    // the next 8 bytes are data, fewer if the image ends before that
+    inst.size = num_of_bytes_fetched < 8 ? num_of_bytes_fetched : 8;
+
+    // keep the bytes themselves so that the invalid instruction can be printed as data
+    inst.imm_val = 0;
+    for (int i = 0; i < inst.size; i++){
+      inst.imm_val |= (uint64_t) inst_buffer[i] << (8 * i);
     }
   }
 
+  memcpy(inst.bytes, inst_buffer, inst.size);
   return inst;
 }
 
 
-// return the address of the next non-zero byte from current address in inputStream
-long get_addr_of_next_non_zero_byte (FILE* inputStream, long currAddr, long file_length){
-  uint8_t read_val[1] = {0};
-  while (currAddr < file_length) {
-    fread(read_val, 1, 1, inputStream);
-    if (read_val[0] != 0) break;
-    currAddr += 1;
+// turn the first size bytes of inst into data (an invalid instruction of that size)
+// a data item holds at most 8 bytes, the rest is left to the next item
+inst_t truncate_to_data (inst_t inst, int size){
+  inst_t data;
+  if (size > 8) {
+    size = 8;
+  }
+  data.type = INVALID;
+  data.size = size;
+  data.imm_val = 0;
+  for (int i = 0; i < size; i++){
+    data.imm_val |= (uint64_t) inst.bytes[i] << (8 * i);
   }
-  return currAddr;
+  memcpy(data.bytes, inst.bytes, size);
+  return data;
 }
 
 // starting at given position of a byte array src, return the next 8 bytes as 
@@ -0,0 +1,258 @@
+#define _GNU_SOURCE   // for SEEK_DATA and madvise
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+// _GNU_SOURCE makes <endian.h> and <signal.h> define these, printRoutines.h has its own
+#undef LITTLE_ENDIAN
+#undef BIG_ENDIAN
+#undef REG_RSP
+#include "imageRoutines.h"
+
+/*********************************************************************
+   Input image access.
+
+   The input can be many gigabytes, so it is never read as a whole.
+   Only a window of IMAGE_WINDOW_SIZE bytes around the current address
+   is mapped at a time. The kernel is told that access is sequential,
+   and the pages behind the cursor are dropped as it moves on, so the
+   resident memory stays flat however large the input is. If the input
+   cannot be mapped, the window is a buffer filled with pread instead.
+
+   Holes in sparse files are skipped with SEEK_DATA without reading
+   them, since they are known to be zero.
+
+   A failed read is never mistaken for the end of the input: it sets
+   image->error, and the caller must check it after every access. If
+   the input shrinks while it is mapped, touching the lost pages raises
+   SIGBUS, which is caught and reported as EIO in the same way.
+********************************************************************************/
+
+static int ensure_window (image_t* image, y86_addr_t addr, size_t size);
+static int move_window (image_t* image, y86_addr_t addr);
+static void release_behind (image_t* image, y86_addr_t addr);
+static void on_fault (int sig);
+
+static sigjmp_buf* volatile fault_jump = NULL;	// where to continue if touching the window faults
+
+
+// open filename for reading, return 0 on success or -1 (with errno set) on failure
+int open_image (image_t* image, const char* filename){
+  struct stat st;
+
+  memset(image, 0, sizeof(image_t));
+  image->fd = open(filename, O_RDONLY);
+  if (image->fd < 0) return -1;
+
+  if (fstat(image->fd, &st) != 0) {
+    int err = errno;
+    close(image->fd);
+    errno = err;
+    return -1;
+  }
+  image->length = st.st_size;
+  image->use_mmap = 1;
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = on_fault;
+  action.sa_flags = SA_NODEFER;
+  sigaction(SIGBUS, &action, NULL);
+  return 0;
+}
+
+// copy up to size bytes starting at addr into buffer, return the number of bytes
+// copied, which is less than size only at the end of the input or if image->error is set
+size_t read_image (image_t* image, y86_addr_t addr, uint8_t* buffer, size_t size){
+  if (addr >= image->length) return 0;
+  if (size > image->length - addr) {
+    size = image->length - addr;
+  }
+  if (ensure_window(image, addr, size) != 0) return 0;
+
+  size_t available = image->window_start + image->window_size - addr;
+  if (size > available) {
+    size = available;
+  }
+
+  sigjmp_buf jump;
+  if (sigsetjmp(jump, 0) != 0) {
+    fault_jump = NULL;
+    image->error = EIO;
+    return 0;
+  }
+  fault_jump = &jump;
+  memcpy(buffer, image->window + (addr - image->window_start), size);
+  fault_jump = NULL;
+
+  release_behind(image, addr);
+  return size;
+}
+
+// return the address of the next non-zero byte at or after addr, or the length of the input
+// if there is none or if image->error is set
+y86_addr_t find_next_non_zero_byte (image_t* image, y86_addr_t addr){
+  while (addr < image->length) {
+    // jump over a hole without reading it
+    off_t data = lseek(image->fd, addr, SEEK_DATA);
+    if (data == -1 && errno == ENXIO) {
+      // no data after addr, which also happens if the input shrank below addr
+      struct stat st;
+      if (fstat(image->fd, &st) != 0 || (y86_addr_t) st.st_size < image->length) {
+        image->error = EIO;
+      }
+      return image->length;
+    }
+    if (data > (off_t) addr) {
+      addr = data;
+      if (addr >= image->length) return image->length;
+    }
+
+    if (ensure_window(image, addr, 1) != 0) return image->length;
+    const uint8_t* bytes = image->window + (addr - image->window_start);
+    size_t available = image->window_start + image->window_size - addr;
+
+    sigjmp_buf jump;
+    if (sigsetjmp(jump, 0) != 0) {
+      fault_jump = NULL;
+      image->error = EIO;
+      return image->length;
+    }
+    fault_jump = &jump;
+
+    // check a word at a time, then find the byte within the word
+    size_t i = 0;
+    uint64_t word;
+    while (i + sizeof(word) <= available) {
+      memcpy(&word, bytes + i, sizeof(word));
+      if (word != 0) break;
+      i += sizeof(word);
+    }
+    while (i < available && bytes[i] == 0) {
+      i++;
+    }
+    fault_jump = NULL;
+
+    addr += i;
+    release_behind(image, addr);
+    if (i < available) return addr;
+  }
+  return image->length;
+}
+
+void close_image (image_t* image){
+  if (image->window != NULL) {
+    if (image->use_mmap) {
+      munmap(image->window, image->window_size);
+    } else {
+      free(image->window);
+    }
+  }
+  close(image->fd);
+  memset(image, 0, sizeof(image_t));
+}
+
+
+// make sure [addr, addr + size) is inside the window, moving the window if needed
+// return 0 on success, or -1 with image->error set on failure
+static int ensure_window (image_t* image, y86_addr_t addr, size_t size){
+  if (image->error != 0) return -1;
+  if (image->window != NULL && addr >= image->window_start &&
+      addr + size <= image->window_start + image->window_size) {
+    return 0;
+  }
+  return move_window(image, addr);
+}
+
+// start the window at the page containing addr
+static int move_window (image_t* image, y86_addr_t addr){
+  y86_addr_t page_size = sysconf(_SC_PAGESIZE);
+  y86_addr_t start = addr - addr % page_size;
+  size_t size = IMAGE_WINDOW_SIZE;
+  if (size > image->length - start) {
+    size = image->length - start;
+  }
+
+  // touching a mapping past the end of a file that shrank would crash, report it instead
+  struct stat st;
+  if (fstat(image->fd, &st) != 0) {
+    image->error = errno;
+    return -1;
+  }
+  if ((y86_addr_t) st.st_size < start + size) {
+    image->error = EIO;
+    return -1;
+  }
+
+  if (image->use_mmap) {
+    if (image->window != NULL) {
+      munmap(image->window, image->window_size);
+      image->window = NULL;
+    }
+    void* window = mmap(NULL, size, PROT_READ, MAP_PRIVATE, image->fd, (off_t) start);
+    if (window == MAP_FAILED) {
+      // not mappable (e.g. a pipe or a special file), fall back to pread
+      image->use_mmap = 0;
+    } else {
+      madvise(window, size, MADV_SEQUENTIAL);
+      image->window = window;
+    }
+  }
+
+  if (!image->use_mmap) {
+    if (image->window == NULL) {
+      image->window = malloc(IMAGE_WINDOW_SIZE);
+      if (image->window == NULL) {
+        image->error = ENOMEM;
+        return -1;
+      }
+    }
+    size_t got = 0;
+    while (got < size) {
+      ssize_t n = pread(image->fd, image->window + got, size - got, (off_t) (start + got));
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) {
+        // a read error, or the input is shorter than when it was opened
+        image->error = n < 0 ? errno : EIO;
+        return -1;
+      }
+      got += n;
+    }
+  }
+
+  image->window_start = start;
+  image->window_size = size;
+  image->released = 0;
+  return 0;
+}
+
+// drop the mapped pages before the page containing addr once enough of them have built up
+static void release_behind (image_t* image, y86_addr_t addr){
+  if (!image->use_mmap) return;
+
+  size_t offset = addr - image->window_start;
+  if (offset < image->released + IMAGE_RELEASE_STRIDE) return;
+
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t end = offset - offset % page_size;
+  madvise(image->window + image->released, end - image->released, MADV_DONTNEED);
+  image->released = end;
+}
+
+// SIGBUS handler: leave the access to the window that faulted, or die as usual if there is none
+static void on_fault (int sig){
+  if (fault_jump != NULL) {
+    siglongjmp(*fault_jump, 1);
+  }
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
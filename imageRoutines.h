@@ -0,0 +1,40 @@
+/* This file contains the prototypes and constants needed to use the
+   input image routines defined in imageRoutines.c
+*/
+
+#ifndef _IMAGEROUTINES_H_
+#define _IMAGEROUTINES_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "printRoutines.h"
+
+#define IMAGE_WINDOW_SIZE (16 << 20)	// bytes of the input mapped (or buffered) at a time
+#define IMAGE_RELEASE_STRIDE (4 << 20)	// release pages behind the cursor every this many bytes
+
+typedef struct {
+	int fd;
+	y86_addr_t length;
+
+	// the part of the input currently accessible, mapped with mmap if
+	// possible and read with pread into a buffer otherwise
+	int use_mmap;
+	uint8_t* window;
+	y86_addr_t window_start;
+	size_t window_size;
+	size_t released;			// bytes at the start of the window already released
+
+	int error;					// errno of the first failed read, 0 if none failed
+} image_t;
+
+int open_image (image_t* image, const char* filename);
+size_t read_image (image_t* image, y86_addr_t addr, uint8_t* buffer, size_t size);
+y86_addr_t find_next_non_zero_byte (image_t* image, y86_addr_t addr);
+void close_image (image_t* image);
+
+
+#endif /* IMAGEROUTINES */
@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <string.h>
+#include "lintRoutines.h"
+
+/*********************************************************************
+   Peephole lint.
+
+   The linter keeps a sliding window of the most recent consecutive
+   instructions and tries every rule in lint_rules against the tail of
+   the window each time an instruction is fed. Data, invalid bytes and
+   skipped zero bytes empty the window, so findings never span them.
+
+   Findings never overlap, so no bytes or cycles are counted twice. A
+   finding of a multi-instruction rule empties the window, so the
+   instructions it covers are not reported again by overlapping windows.
+   A one-instruction finding is held back until its instruction leaves
+   the window; if a multi-instruction finding covers it first, it is
+   dropped. Findings are therefore printed up to LINT_WINDOW_SIZE - 1
+   instructions late, and each one names the address it starts at.
+
+   To add a rule, write a match function and add a row to lint_rules;
+   raise LINT_WINDOW_SIZE if the rule needs a longer window.
+
+   Cycle estimates assume the pipelined implementation, where every
+   instruction issues in one cycle and a load followed by a use of the
+   loaded register costs one extra bubble.
+********************************************************************************/
+
+static int match_zero_irmovq (inst_t* window, lint_fix_t* fix);
+static int match_self_move (inst_t* window, lint_fix_t* fix);
+static int match_push_pop (inst_t* window, lint_fix_t* fix);
+static int match_store_load (inst_t* window, lint_fix_t* fix);
+static int match_irmovq_addq_chain (inst_t* window, lint_fix_t* fix);
+static void report_finding (linter_t* linter, lint_finding_t* finding, FILE* out);
+static void flush_findings (linter_t* linter, y86_addr_t before, FILE* out);
+
+static const lint_rule_t lint_rules[] = {
+  { "zero-irmovq",      1, match_zero_irmovq },
+  { "self-move",        1, match_self_move },
+  { "push-pop",         2, match_push_pop },
+  { "store-load",       2, match_store_load },
+  { "irmovq-addq-fold", 4, match_irmovq_addq_chain },
+};
+
+#define NUM_OF_LINT_RULES (int) (sizeof(lint_rules) / sizeof(lint_rules[0]))
+
+
+void init_linter (linter_t* linter, int print_inline){
+  memset(linter, 0, sizeof(linter_t));
+  linter->print_inline = print_inline;
+  linter->expected_addr = INVALID_ADDR;
+}
+
+// slide the window over the instruction at currAddr and print every finding that can no longer be
+// covered by a longer one to out file
+void lint_feed (linter_t* linter, inst_t inst, y86_addr_t currAddr, FILE* out){
+  if (currAddr != linter->expected_addr || inst.type == INVALID) {
+    flush_findings(linter, INVALID_ADDR, out);
+    linter->window_count = 0;
+  }
+  linter->expected_addr = currAddr + inst.size;
+  if (inst.type == INVALID) return;
+
+  if (linter->window_count == LINT_WINDOW_SIZE) {
+    flush_findings(linter, linter->window_addr[1], out);
+    memmove(linter->window, linter->window + 1, (LINT_WINDOW_SIZE - 1) * sizeof(inst_t));
+    memmove(linter->window_addr, linter->window_addr + 1, (LINT_WINDOW_SIZE - 1) * sizeof(y86_addr_t));
+    linter->window_count--;
+  }
+  linter->window[linter->window_count] = inst;
+  linter->window_addr[linter->window_count] = currAddr;
+  linter->window_count++;
+
+  for (int r = 0; r < NUM_OF_LINT_RULES; r++) {
+    lint_finding_t finding;
+    finding.rule = &lint_rules[r];
+    int first = linter->window_count - finding.rule->length;
+    if (first < 0 || !finding.rule->match(&linter->window[first], &finding.fix)) continue;
+    finding.addr = linter->window_addr[first];
+
+    if (finding.rule->length == 1) {
+      if (linter->num_of_pending == LINT_WINDOW_SIZE) {
+        flush_findings(linter, linter->pending[0].addr + 1, out);
+      }
+      linter->pending[linter->num_of_pending++] = finding;
+      continue;
+    }
+
+    // the instructions of this finding are consumed: held findings among them are dropped,
+    // and later rules see an empty window
+    while (linter->num_of_pending > 0 && linter->pending[linter->num_of_pending - 1].addr >= finding.addr) {
+      linter->num_of_pending--;
+    }
+    flush_findings(linter, INVALID_ADDR, out);
+    report_finding(linter, &finding, out);
+    linter->window_count = 0;
+  }
+}
+
+void print_lint_totals (linter_t* linter, FILE* out){
+  flush_findings(linter, INVALID_ADDR, out);
+  fprintf(out, "%s%ld findings, %ld bytes and ~%ld cycles could be saved\n",
+          linter->print_inline ? "# lint: " : "", linter->num_of_findings, linter->bytes_saved, linter->cycles_saved);
+}
+
+// count a finding and print it to out file
+static void report_finding (linter_t* linter, lint_finding_t* finding, FILE* out){
+  linter->num_of_findings++;
+  linter->bytes_saved += finding->fix.bytes_saved;
+  linter->cycles_saved += finding->fix.cycles_saved;
+
+  if (linter->print_inline) {
+    fprintf(out, "%40s# lint %s at 0x%lx: %s (saves %d bytes, ~%d cycles)\n", "", finding->rule->name,
+            finding->addr, finding->fix.suggestion, finding->fix.bytes_saved, finding->fix.cycles_saved);
+  } else {
+    fprintf(out, "%016lx: %-18s%s (saves %d bytes, ~%d cycles)\n", finding->addr,
+            finding->rule->name, finding->fix.suggestion, finding->fix.bytes_saved, finding->fix.cycles_saved);
+  }
+}
+
+// report the held findings that start before the given address, in address order
+static void flush_findings (linter_t* linter, y86_addr_t before, FILE* out){
+  int n = 0;
+  while (n < linter->num_of_pending && linter->pending[n].addr < before) {
+    report_finding(linter, &linter->pending[n], out);
+    n++;
+  }
+  linter->num_of_pending -= n;
+  memmove(linter->pending, linter->pending + n, linter->num_of_pending * sizeof(lint_finding_t));
+}
+
+
+// irmovq $0x0, R  ->  xorq R, R
+static int match_zero_irmovq (inst_t* window, lint_fix_t* fix){
+  if (window[0].type != IRMOVQ || window[0].imm_val != 0) return 0;
+  const char* r = get_reg_name(window[0].rb);
+  fix->bytes_saved = 8;
+  fix->cycles_saved = 0;
+  snprintf(fix->suggestion, MAX_SUGGESTION_LENGTH, "xorq %s, %s if the condition codes are dead", r, r);
+  return 1;
+}
+
+// rrmovq R, R (or any cmovXX R, R) does nothing
+static int match_self_move (inst_t* window, lint_fix_t* fix){
+  if (window[0].type != CMOVXX || window[0].ra != window[0].rb) return 0;
+  fix->bytes_saved = 2;
+  fix->cycles_saved = 1;
+  snprintf(fix->suggestion, MAX_SUGGESTION_LENGTH, "delete %s %s, %s",
+           get_opcode_name(window[0].opcode), get_reg_name(window[0].ra), get_reg_name(window[0].rb));
+  return 1;
+}
+
+// pushq R; popq R  ->  nothing
+// pushq R; popq S  ->  rrmovq R, S
+static int match_push_pop (inst_t* window, lint_fix_t* fix){
+  if (window[0].type != PUSHQ || window[1].type != POPQ) return 0;
+  const char* r = get_reg_name(window[0].ra);
+  const char* s = get_reg_name(window[1].ra);
+
+  if (window[0].ra == window[1].ra) {
+    fix->bytes_saved = 4;
+    fix->cycles_saved = 2;
+    snprintf(fix->suggestion, MAX_SUGGESTION_LENGTH, "delete pushq %s; popq %s", r, s);
+    return 1;
+  }
+  if (window[0].ra == REG_RSP || window[1].ra == REG_RSP) return 0;
+  fix->bytes_saved = 2;
+  fix->cycles_saved = 1;
+  snprintf(fix->suggestion, MAX_SUGGESTION_LENGTH, "rrmovq %s, %s", r, s);
+  return 1;
+}
+
+// rmmovq R, D(B); mrmovq D(B), S  ->  rmmovq R, D(B); rrmovq R, S
+static int match_store_load (inst_t* window, lint_fix_t* fix){
+  if (window[0].type != RMMOVQ || window[1].type != MRMOVQ) return 0;
+  if (window[0].rb != window[1].rb || window[0].imm_val != window[1].imm_val) return 0;
+  const char* r = get_reg_name(window[0].ra);
+  const char* s = get_reg_name(window[1].ra);
+
+  if (window[0].ra == window[1].ra) {
+    fix->bytes_saved = 10;
+    fix->cycles_saved = 1;
+    snprintf(fix->suggestion, MAX_SUGGESTION_LENGTH, "delete mrmovq %#lx(%s), %s; %s already holds the value",
+             window[1].imm_val, get_reg_name(window[1].rb), s, r);
+    return 1;
+  }
+  fix->bytes_saved = 8;
+  fix->cycles_saved = 1;
+  snprintf(fix->suggestion, MAX_SUGGESTION_LENGTH, "rrmovq %s, %s instead of reloading %#lx(%s)",
+           r, s, window[1].imm_val, get_reg_name(window[1].rb));
+  return 1;
+}
+
+// irmovq $a, R; addq R, S; irmovq $b, R; addq R, S  ->  irmovq $(a+b), R; addq R, S
+static int match_irmovq_addq_chain (inst_t* window, lint_fix_t* fix){
+  for (int i = 0; i < 4; i += 2) {
+    if (window[i].type != IRMOVQ || window[i+1].type != OPQ || window[i+1].opq_type != ADD) return 0;
+    if (window[i+1].ra != window[i].rb || window[i+1].rb == window[i].rb) return 0;
+  }
+  if (window[0].rb != window[2].rb || window[1].rb != window[3].rb) return 0;
+
+  const char* r = get_reg_name(window[0].rb);
+  fix->bytes_saved = 12;
+  fix->cycles_saved = 2;
+  snprintf(fix->suggestion, MAX_SUGGESTION_LENGTH, "irmovq $%#lx, %s; addq %s, %s if %s is dead afterwards",
+           window[0].imm_val + window[2].imm_val, r, r, get_reg_name(window[1].rb), r);
+  return 1;
+}
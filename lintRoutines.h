@@ -0,0 +1,59 @@
+/* This file contains the prototypes and constants needed to use the
+   peephole lint routines defined in lintRoutines.c
+*/
+
+#ifndef _LINTROUTINES_H_
+#define _LINTROUTINES_H_
+
+#include <stdio.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "printRoutines.h"
+
+#define LINT_WINDOW_SIZE 4			// number of instructions in the longest rule
+#define MAX_SUGGESTION_LENGTH 128
+
+typedef struct {
+	int bytes_saved;
+	int cycles_saved;
+	char suggestion[MAX_SUGGESTION_LENGTH];
+} lint_fix_t;
+
+// a rule is given its window of consecutive instructions (oldest first) and
+// returns 1 after filling in fix if the window contains a slow idiom, or 0 otherwise
+typedef int (*lint_match_t) (inst_t* window, lint_fix_t* fix);
+
+typedef struct {
+	const char* name;
+	int length;					// number of instructions the rule looks at
+	lint_match_t match;
+} lint_rule_t;
+
+typedef struct {
+	const lint_rule_t* rule;
+	y86_addr_t addr;			// address of the first instruction of the finding
+	lint_fix_t fix;
+} lint_finding_t;
+
+typedef struct {
+	int print_inline;			// print findings as comments between listing lines
+	inst_t window[LINT_WINDOW_SIZE];
+	y86_addr_t window_addr[LINT_WINDOW_SIZE];
+	int window_count;
+	y86_addr_t expected_addr;	// address right after the previously fed instruction
+	lint_finding_t pending[LINT_WINDOW_SIZE];	// one-instruction findings a longer rule may still cover
+	int num_of_pending;
+
+	long num_of_findings;
+	long bytes_saved;
+	long cycles_saved;
+} linter_t;
+
+void init_linter (linter_t* linter, int print_inline);
+void lint_feed (linter_t* linter, inst_t inst, y86_addr_t currAddr, FILE* out);
+void print_lint_totals (linter_t* linter, FILE* out);
+
+
+#endif /* LINTROUTINES */
@@ -162,6 +162,109 @@ const char* get_reg_name (uint8_t reg){
     }
 }
 
+// return the mnemonic of the instruction encoded by given opcode, or NULL if the opcode is invalid
+const char* get_opcode_name (uint8_t opcode){
+  switch (opcode){
+    case 0x00:
+            return "halt";
+    case 0x10:
+            return "nop";
+    case 0x20:
+            return "rrmovq";
+    case 0x21:
+            return "cmovle";
+    case 0x22:
+            return "cmovl";
+    case 0x23:
+            return "cmove";
+    case 0x24:
+            return "cmovne";
+    case 0x25:
+            return "cmovge";
+    case 0x26:
+            return "cmovg";
+    case 0x30:
+            return "irmovq";
+    case 0x40:
+            return "rmmovq";
+    case 0x50:
+            return "mrmovq";
+    case 0x60:
+            return "addq";
+    case 0x61:
+            return "subq";
+    case 0x62:
+            return "andq";
+    case 0x63:
+            return "xorq";
+    case 0x70:
+            return "jmp";
+    case 0x71:
+            return "jle";
+    case 0x72:
+            return "jl";
+    case 0x73:
+            return "je";
+    case 0x74:
+            return "jne";
+    case 0x75:
+            return "jge";
+    case 0x76:
+            return "jg";
+    case 0x80:
+            return "call";
+    case 0x90:
+            return "ret";
+    case 0xa0:
+            return "pushq";
+    case 0xb0:
+            return "popq";
+    default:
+            return NULL;
+  }
+}
+
+// store the registers read and written by given instruction as bitmasks (bit i is register i)
+// %rsp counts as both read and written by the instructions that move the stack pointer
+void get_inst_reg_usage(inst_t inst, uint16_t* reads, uint16_t* writes){
+  *reads = 0;
+  *writes = 0;
+  switch(inst.type){
+    case CMOVXX:
+        *reads = 1 << inst.ra;
+        *writes = 1 << inst.rb;
+        break;
+    case IRMOVQ:
+        *writes = 1 << inst.rb;
+        break;
+    case RMMOVQ:
+        *reads = 1 << inst.ra | 1 << inst.rb;
+        break;
+    case MRMOVQ:
+        *reads = 1 << inst.rb;
+        *writes = 1 << inst.ra;
+        break;
+    case OPQ:
+        *reads = 1 << inst.ra | 1 << inst.rb;
+        *writes = 1 << inst.rb;
+        break;
+    case PUSHQ:
+        *reads = 1 << inst.ra | 1 << REG_RSP;
+        *writes = 1 << REG_RSP;
+        break;
+    case POPQ:
+        *reads = 1 << REG_RSP;
+        *writes = 1 << inst.ra | 1 << REG_RSP;
+        break;
+    case CALL: case RET:
+        *reads = 1 << REG_RSP;
+        *writes = 1 << REG_RSP;
+        break;
+    default:
+        break;
+  }
+}
+
 // store memory value (in integer representation) of current instruction to buffer
 void get_inst_mem_val(char* buffer, inst_t inst){
   switch(inst.type){
@@ -199,9 +302,14 @@ void convert_imm_val_to_byte_array(char* buffer, uint64_t imm_val, int start_pos
 }
 
 // print current address, memory value and assembly of given instruction to out file
-void print_assembly (inst_t inst, long currAddr, FILE* out){
-  char* inst_name;
+void print_assembly (inst_t inst, y86_addr_t currAddr, FILE* out){
+  print_assembly_line(inst, currAddr, out);
+  fputc('\n', out);
+}
 
+// same as print_assembly but without ending the line, so that the caller can append
+// a comment to it; return the number of characters printed
+int print_assembly_line (inst_t inst, y86_addr_t currAddr, FILE* out){
   // store memory value of current instion in mem_val using hex string representation 
   char buffer[11] = {0};          // 10 bytes for longest instruction + 1 byte for end of string character = 11 bytes
   get_inst_mem_val(buffer, inst); // each buffer element contains two digits of memory value in integer representation
@@ -213,32 +321,41 @@ void print_assembly (inst_t inst, long currAddr, FILE* out){
   }
   
   // print current instruction to output file
+  char assembly[MAX_ASSEMBLY_LENGTH];
+  get_inst_assembly(assembly, inst);
+  return fprintf(out, "%016lx: %-22s%s", currAddr, mem_val, assembly);
+}
+
+// store the assembly of given instruction (mnemonic and operands, without address) to buffer
+void get_inst_assembly (char* buffer, inst_t inst){
+  char* inst_name;
+
   switch(inst.type) {
     case HALT:
-            fprintf(out, "%016lx: %-22s%-8s\n", currAddr, mem_val, "halt");
+            sprintf(buffer, "%-8s", "halt");
             break;
     case NOP:
-            fprintf(out, "%016lx: %-22s%-8s\n", currAddr, mem_val, "nop");
+            sprintf(buffer, "%-8s", "nop");
             break;
     case RET:
-            fprintf(out, "%016lx: %-22s%-8s\n", currAddr, mem_val, "ret");
+            sprintf(buffer, "%-8s", "ret");
             break;
 
 
     case IRMOVQ:
-            fprintf(out, "%016lx: %-22s%-8s$%#lx, %s\n", currAddr, mem_val, "irmovq", inst.imm_val, get_reg_name(inst.rb));
+            sprintf(buffer, "%-8s$%#lx, %s", "irmovq", inst.imm_val, get_reg_name(inst.rb));
             break;
 
     case RMMOVQ:
-            fprintf(out, "%016lx: %-22s%-8s%s, %#lx(%s)\n", currAddr, mem_val, "rmmovq", get_reg_name(inst.ra), inst.imm_val, get_reg_name(inst.rb)); 
+            sprintf(buffer, "%-8s%s, %#lx(%s)", "rmmovq", get_reg_name(inst.ra), inst.imm_val, get_reg_name(inst.rb)); 
             break;
 
     case MRMOVQ:
-            fprintf(out, "%016lx: %-22s%-8s%#lx(%s), %s\n", currAddr, mem_val, "mrmovq", inst.imm_val, get_reg_name(inst.rb), get_reg_name(inst.ra)); // rb is before ra in the assembly of mrmovq
+            sprintf(buffer, "%-8s%#lx(%s), %s", "mrmovq", inst.imm_val, get_reg_name(inst.rb), get_reg_name(inst.ra)); // rb is before ra in the assembly of mrmovq
             break;
 
     case CALL:
-            fprintf(out, "%016lx: %-22s%-8s%#lx\n", currAddr, mem_val, "call", inst.imm_val);
+            sprintf(buffer, "%-8s%#lx", "call", inst.imm_val);
             break;
 
     case CMOVXX:
@@ -266,7 +383,7 @@ void print_assembly (inst_t inst, long currAddr, FILE* out){
                       break;
             }
 
-            fprintf(out, "%016lx: %-22s%-8s%s, %s\n", currAddr, mem_val, inst_name, get_reg_name(inst.ra), get_reg_name(inst.rb));
+            sprintf(buffer, "%-8s%s, %s", inst_name, get_reg_name(inst.ra), get_reg_name(inst.rb));
             break;
     case OPQ:
             switch(inst.opq_type) {
@@ -283,7 +400,7 @@ void print_assembly (inst_t inst, long currAddr, FILE* out){
                       inst_name = "xorq";
                       break;
             }
-            fprintf(out, "%016lx: %-22s%-8s%s, %s\n", currAddr, mem_val, inst_name, get_reg_name(inst.ra), get_reg_name(inst.rb));
+            sprintf(buffer, "%-8s%s, %s", inst_name, get_reg_name(inst.ra), get_reg_name(inst.rb));
             break;
 
     case JXX:
@@ -310,21 +427,40 @@ void print_assembly (inst_t inst, long currAddr, FILE* out){
                       inst_name = "jg";
                       break;
             }
-            fprintf(out, "%016lx: %-22s%-8s%#lx\n", currAddr, mem_val, inst_name, inst.imm_val);
+            sprintf(buffer, "%-8s%#lx", inst_name, inst.imm_val);
             break;
 
     case PUSHQ:
             inst_name = "pushq";
-            fprintf(out, "%016lx: %-22s%-8s%s\n", currAddr, mem_val, inst_name, get_reg_name(inst.ra));
+            sprintf(buffer, "%-8s%s", inst_name, get_reg_name(inst.ra));
             break;
 
     case POPQ:
             inst_name = "popq";
-            fprintf(out, "%016lx: %-22s%-8s%s\n", currAddr, mem_val, inst_name, get_reg_name(inst.ra));
+            sprintf(buffer, "%-8s%s", inst_name, get_reg_name(inst.ra));
             break;
 
     default:
-            // invalid instruction, already handled in fetch_instruction
+            // invalid instruction, printed as data by print_data
+            buffer[0] = '\0';
             break;
   }
+
+}
+
+// print invalid instruction as data: a .quad if it is 8 bytes long, otherwise
+// (at the end of the input or before a traced address) one .byte per byte
+void print_data (inst_t inst, y86_addr_t currAddr, FILE* out){
+  char mem_val[8*2+1] = {0};
+  if (inst.size < 8){
+    for (int i = 0; i < inst.size; i++){
+      sprintf(mem_val, "%02x", inst.bytes[i]);
+      fprintf(out, "%016lx: %-22s.byte %#02hhx\n", currAddr + i, mem_val, inst.bytes[i]);
+    }
+  } else {
+    for (int i = 0; i < 8; i++){
+      sprintf(mem_val+2*i, "%02x", inst.bytes[i]);
+    }
+    fprintf(out, "%016lx: %-22s.quad %#lx\n", currAddr, mem_val, inst.imm_val);
+  }
 }
\ No newline at end of file
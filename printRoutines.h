@@ -13,6 +13,16 @@
 #define LITTLE_ENDIAN 0
 #define BIG_ENDIAN 1
 
+// addresses in the input (and offsets and lengths of it) are always 64 bits,
+// so that images larger than 4 GB work the same as small ones
+typedef uint64_t y86_addr_t;
+#define INVALID_ADDR ((y86_addr_t) -1)
+
+#define MAX_ASSEMBLY_LENGTH 64
+
+#define NUM_OF_REGS 15
+#define REG_RSP 4
+
 typedef enum y86_instruction_type {
 	HALT, NOP, RET, CMOVXX, IRMOVQ, RMMOVQ, MRMOVQ, OPQ, JXX, CALL, PUSHQ, POPQ, INVALID
 } inst_type_t;
@@ -35,8 +45,9 @@ typedef struct {
 	uint8_t opcode;
 	uint8_t ra;
 	uint8_t rb;
-	uint64_t imm_val;	 		// immediate value in the instruction
+	uint64_t imm_val;	 		// immediate value in the instruction (the bytes themselves if INVALID)
 	char* mem_val;				// memory value (in hex) of the instruction
+	uint8_t bytes[10];			// bytes the instruction was decoded from
 	cmove_type_t cmov_type;
 	opq_type_t	opq_type;
 	jump_type_t	jump_type;
@@ -44,9 +55,14 @@ typedef struct {
 
 int samplePrint(FILE *);
 const char* get_reg_name (uint8_t reg);
-void print_assembly (inst_t inst, long currAddr, FILE* out);
+const char* get_opcode_name (uint8_t opcode);
+void print_assembly (inst_t inst, y86_addr_t currAddr, FILE* out);
+int print_assembly_line (inst_t inst, y86_addr_t currAddr, FILE* out);
+void get_inst_assembly (char* buffer, inst_t inst);
+void print_data (inst_t inst, y86_addr_t currAddr, FILE* out);
 uint64_t get_8_bytes_from_array (uint8_t* src, int start_pos, int output_endianness);
 void get_inst_mem_val(char* buffer, inst_t inst);
+void get_inst_reg_usage(inst_t inst, uint16_t* reads, uint16_t* writes);
 void convert_imm_val_to_byte_array(char* buffer, uint64_t imm_val, int start_pos);
 
 
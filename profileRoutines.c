@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <string.h>
+#include "profileRoutines.h"
+
+/*********************************************************************
+   Program profile.
+
+   The profile is a set of counters updated once per decoded
+   instruction (or data item) and once per skipped zero-fill region,
+   so it is built in the same single pass as the listing would be,
+   without formatting any text. print_profile turns the counters into
+   a one-screen summary of the image.
+********************************************************************************/
+
+static void add_largest_region (region_t* regions, y86_addr_t start, y86_addr_t size);
+static void end_invalid_cluster (profile_t* profile);
+static void print_count (FILE* out, int indent, const char* name, long count, long total);
+static void print_regions (FILE* out, const char* title, region_t* regions);
+
+static const char* inst_type_names[INVALID + 1] = {
+  "halt", "nop", "ret", "cmovXX", "irmovq", "rmmovq", "mrmovq", "OPq", "jXX", "call", "pushq", "popq", "invalid"
+};
+
+
+void init_profile (profile_t* profile){
+  memset(profile, 0, sizeof(profile_t));
+}
+
+// count the instruction at currAddr, invalid instructions count as data
+void profile_inst (profile_t* profile, inst_t inst, y86_addr_t currAddr){
+  profile->inst_count[inst.type]++;
+
+  if (inst.type == INVALID) {
+    if (inst.size == 8) {
+      profile->quad_bytes += inst.size;
+    } else {
+      profile->byte_bytes += inst.size;
+    }
+
+    // extend the current cluster of invalid bytes if this item is right after it
+    if (profile->invalid_cluster.size > 0 && profile->invalid_cluster.start + profile->invalid_cluster.size != currAddr) {
+      end_invalid_cluster(profile);
+    }
+    if (profile->invalid_cluster.size == 0) {
+      profile->invalid_cluster.start = currAddr;
+    }
+    profile->invalid_cluster.size += inst.size;
+    return;
+  }
+
+  end_invalid_cluster(profile);
+
+  profile->code_bytes += inst.size;
+  profile->size_count[inst.size]++;
+
+  switch (inst.type) {
+    case CMOVXX:
+        profile->cmov_count[inst.cmov_type]++;
+        break;
+    case OPQ:
+        profile->opq_count[inst.opq_type]++;
+        break;
+    case JXX:
+        profile->jump_count[inst.jump_type]++;
+        break;
+    default:
+        break;
+  }
+
+  uint16_t reads, writes;
+  get_inst_reg_usage(inst, &reads, &writes);
+  for (int reg = 0; reg < NUM_OF_REGS; reg++) {
+    profile->reg_reads[reg] += reads >> reg & 1;
+    profile->reg_writes[reg] += writes >> reg & 1;
+  }
+}
+
+// count the zero bytes in [start, end) that were skipped instead of disassembled
+void profile_zero_fill (profile_t* profile, y86_addr_t start, y86_addr_t end){
+  if (end <= start) return;
+  end_invalid_cluster(profile);
+  profile->zero_bytes += end - start;
+  add_largest_region(profile->largest_zero_fills, start, end - start);
+}
+
+// print the summary of everything counted so far to out file
+void print_profile (profile_t* profile, FILE* out){
+  end_invalid_cluster(profile);
+
+  long total_bytes = profile->code_bytes + profile->quad_bytes + profile->byte_bytes + profile->zero_bytes;
+  long total_insts = 0;
+  for (int type = 0; type < INVALID; type++) {
+    total_insts += profile->inst_count[type];
+  }
+
+  fprintf(out, "Layout (%ld bytes)\n", total_bytes);
+  print_count(out, 2, "code", profile->code_bytes, total_bytes);
+  print_count(out, 2, ".quad", profile->quad_bytes, total_bytes);
+  print_count(out, 2, ".byte", profile->byte_bytes, total_bytes);
+  print_count(out, 2, "zero", profile->zero_bytes, total_bytes);
+
+  fprintf(out, "\nInstructions (%ld)\n", total_insts);
+  for (int type = 0; type < INVALID; type++) {
+    print_count(out, 2, inst_type_names[type], profile->inst_count[type], total_insts);
+    if (type == CMOVXX) {
+      for (int i = RRMOVQ; i <= CMOVG; i++) {
+        print_count(out, 4, get_opcode_name(0x20 + i), profile->cmov_count[i], total_insts);
+      }
+    } else if (type == OPQ) {
+      for (int i = ADD; i <= XOR; i++) {
+        print_count(out, 4, get_opcode_name(0x60 + i), profile->opq_count[i], total_insts);
+      }
+    } else if (type == JXX) {
+      for (int i = JMP; i <= JG; i++) {
+        print_count(out, 4, get_opcode_name(0x70 + i), profile->jump_count[i], total_insts);
+      }
+    }
+  }
+
+  fprintf(out, "\nInstruction sizes\n");
+  for (int size = 1; size <= MAX_INST_SIZE; size++) {
+    if (profile->size_count[size] == 0) continue;
+    fprintf(out, "  %2d bytes  %12ld\n", size, profile->size_count[size]);
+  }
+
+  fprintf(out, "\nRegisters         reads       writes\n");
+  for (int reg = 0; reg < NUM_OF_REGS; reg++) {
+    fprintf(out, "  %-6s  %12ld %12ld\n", get_reg_name(reg), profile->reg_reads[reg], profile->reg_writes[reg]);
+  }
+
+  print_regions(out, "Largest zero-fill regions", profile->largest_zero_fills);
+  print_regions(out, "Largest invalid-byte clusters", profile->largest_invalid_clusters);
+}
+
+
+// keep regions sorted by size (largest first), dropping the smallest when full
+static void add_largest_region (region_t* regions, y86_addr_t start, y86_addr_t size){
+  int i = NUM_OF_LARGEST_REGIONS;
+  while (i > 0 && regions[i-1].size < size) {
+    if (i < NUM_OF_LARGEST_REGIONS) {
+      regions[i] = regions[i-1];
+    }
+    i--;
+  }
+  if (i < NUM_OF_LARGEST_REGIONS) {
+    regions[i].start = start;
+    regions[i].size = size;
+  }
+}
+
+static void end_invalid_cluster (profile_t* profile){
+  if (profile->invalid_cluster.size == 0) return;
+  add_largest_region(profile->largest_invalid_clusters, profile->invalid_cluster.start, profile->invalid_cluster.size);
+  profile->invalid_cluster.size = 0;
+}
+
+static void print_count (FILE* out, int indent, const char* name, long count, long total){
+  if (indent > 2 && count == 0) return;   // keep the report on one screen, only list subtypes that occur
+  double percent = total > 0 ? 100.0 * count / total : 0.0;
+  fprintf(out, "%*s%-*s  %12ld  %5.1f%%\n", indent, "", 10 - indent, name, count, percent);
+}
+
+static void print_regions (FILE* out, const char* title, region_t* regions){
+  fprintf(out, "\n%s\n", title);
+  if (regions[0].size == 0) {
+    fprintf(out, "  none\n");
+    return;
+  }
+  for (int i = 0; i < NUM_OF_LARGEST_REGIONS && regions[i].size > 0; i++) {
+    fprintf(out, "  %016lx-%016lx  %12lu bytes\n", regions[i].start, regions[i].start + regions[i].size - 1, regions[i].size);
+  }
+}
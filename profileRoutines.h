@@ -0,0 +1,48 @@
+/* This file contains the prototypes and constants needed to use the
+   program profile routines defined in profileRoutines.c
+*/
+
+#ifndef _PROFILEROUTINES_H_
+#define _PROFILEROUTINES_H_
+
+#include <stdio.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "printRoutines.h"
+
+#define NUM_OF_LARGEST_REGIONS 5	// number of zero-fill regions and invalid clusters to report
+#define MAX_INST_SIZE 10
+
+typedef struct {
+	y86_addr_t start;
+	y86_addr_t size;
+} region_t;
+
+typedef struct {
+	long inst_count[INVALID + 1];		// per inst_type_t, INVALID counts data items
+	long cmov_count[CMOVG + 1];
+	long opq_count[XOR + 1];
+	long jump_count[JG + 1];
+	long size_count[MAX_INST_SIZE + 1];	// histogram of valid instruction sizes
+	long reg_reads[NUM_OF_REGS];
+	long reg_writes[NUM_OF_REGS];
+
+	long code_bytes;
+	long quad_bytes;
+	long byte_bytes;
+	long zero_bytes;
+
+	region_t largest_zero_fills[NUM_OF_LARGEST_REGIONS];		// sorted by size, largest first
+	region_t largest_invalid_clusters[NUM_OF_LARGEST_REGIONS];
+	region_t invalid_cluster;			// run of invalid bytes still being extended
+} profile_t;
+
+void init_profile (profile_t* profile);
+void profile_inst (profile_t* profile, inst_t inst, y86_addr_t currAddr);
+void profile_zero_fill (profile_t* profile, y86_addr_t start, y86_addr_t end);
+void print_profile (profile_t* profile, FILE* out);
+
+
+#endif /* PROFILEROUTINES */
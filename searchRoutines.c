@@ -0,0 +1,436 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "searchRoutines.h"
+
+/*********************************************************************
+   Instruction-pattern search.
+
+   A pattern file contains one pattern per line. A pattern is a
+   sequence of instructions separated by ";" and written in the same
+   syntax print_assembly emits, e.g.
+
+       mrmovq X(%rdx), R; addq R, %rax
+
+   Any operand may be replaced by a wildcard name (an identifier such
+   as X or R). Every occurrence of the same wildcard within a pattern
+   must match the same value. Blank lines and lines starting with "#"
+   are ignored.
+
+   All patterns are compiled into a single Aho-Corasick automaton over
+   opcodes, so the decoded stream is scanned in one pass no matter how
+   many patterns there are. Whenever the automaton reaches a node where
+   a pattern ends, the operands of the last few instructions are
+   checked against the pattern (this is where the wildcards are bound).
+   Matches never span data, invalid bytes or skipped zero bytes.
+********************************************************************************/
+
+static const char* skip_spaces (const char* s);
+static const char* parse_wildcard (const char* s, pattern_t* pattern, operand_pattern_t* operand);
+static const char* parse_reg_operand (const char* s, pattern_t* pattern, operand_pattern_t* operand);
+static const char* parse_val_operand (const char* s, pattern_t* pattern, operand_pattern_t* operand);
+static const char* parse_mem_operand (const char* s, pattern_t* pattern, operand_pattern_t* disp, operand_pattern_t* base);
+static const char* expect_char (const char* s, char c);
+static int parse_inst_pattern (const char* text, pattern_t* pattern, inst_pattern_t* inst_pattern);
+static int parse_pattern (char* line, pattern_t* pattern);
+static int build_automaton (searcher_t* searcher);
+static int add_node (searcher_t* searcher);
+static int match_pattern (searcher_t* searcher, pattern_t* pattern);
+static int match_operand (operand_pattern_t* operand, uint64_t value, uint64_t* bound, uint32_t* is_bound);
+static void add_match (searcher_t* searcher, y86_addr_t addr, int pattern);
+static int compare_matches (const void* a, const void* b);
+
+
+// read all patterns from patternFile and compile them into searcher
+// return 0 on success, or -1 (after printing the reason) if the file is malformed
+int load_search_patterns (searcher_t* searcher, FILE* patternFile){
+  char line[MAX_PATTERN_LINE_LENGTH];
+  int line_num = 0;
+
+  memset(searcher, 0, sizeof(searcher_t));
+  searcher->expected_addr = INVALID_ADDR;
+
+  while (fgets(line, sizeof(line), patternFile) != NULL) {
+    line_num++;
+
+    // strip trailing newline and whitespace
+    size_t len = strlen(line);
+    while (len > 0 && isspace((unsigned char) line[len-1])) {
+      line[--len] = '\0';
+    }
+    char* start = (char*) skip_spaces(line);
+    if (*start == '\0' || *start == '#') continue;
+
+    pattern_t* patterns = realloc(searcher->patterns, (searcher->num_of_patterns + 1) * sizeof(pattern_t));
+    if (patterns == NULL) {
+      printf("Out of memory while loading patterns\n");
+      return -1;
+    }
+    searcher->patterns = patterns;
+
+    pattern_t* pattern = &searcher->patterns[searcher->num_of_patterns];
+    memset(pattern, 0, sizeof(pattern_t));
+    pattern->text = malloc(strlen(start) + 1);
+    if (pattern->text == NULL) {
+      printf("Out of memory while loading patterns\n");
+      return -1;
+    }
+    strcpy(pattern->text, start);
+    searcher->num_of_patterns++;
+
+    if (parse_pattern(start, pattern) != 0) {
+      printf("Invalid pattern on line %d: %s\n", line_num, pattern->text);
+      return -1;
+    }
+  }
+
+  if (searcher->num_of_patterns == 0) {
+    printf("No patterns found in pattern file\n");
+    return -1;
+  }
+
+  return build_automaton(searcher);
+}
+
+// feed the instruction at currAddr to the automaton and record every pattern ending at it
+// invalid instructions (printed as data) and address discontinuities restart the scan
+void search_feed (searcher_t* searcher, inst_t inst, y86_addr_t currAddr){
+  if (currAddr != searcher->expected_addr) {
+    searcher->state = 0;
+  }
+  searcher->expected_addr = currAddr + inst.size;
+
+  if (inst.type == INVALID) {
+    searcher->state = 0;
+    return;
+  }
+
+  searcher->history_pos = (searcher->history_pos + 1) % MAX_PATTERN_LENGTH;
+  searcher->history[searcher->history_pos] = inst;
+  searcher->history_addr[searcher->history_pos] = currAddr;
+
+  searcher->state = searcher->nodes[searcher->state].next[inst.opcode];
+
+  int node = searcher->state;
+  if (searcher->nodes[node].first_pattern == -1) {
+    node = searcher->nodes[node].output_link;
+  }
+  while (node != 0) {
+    for (int p = searcher->nodes[node].first_pattern; p != -1; p = searcher->patterns[p].next_at_same_node) {
+      pattern_t* pattern = &searcher->patterns[p];
+      if (match_pattern(searcher, pattern)) {
+        int first = (searcher->history_pos - (pattern->length - 1) + MAX_PATTERN_LENGTH) % MAX_PATTERN_LENGTH;
+        add_match(searcher, searcher->history_addr[first], p);
+      }
+    }
+    node = searcher->nodes[node].output_link;
+  }
+}
+
+// print all matches found so far in address order
+void print_search_matches (searcher_t* searcher, FILE* out){
+  qsort(searcher->matches, searcher->num_of_matches, sizeof(search_match_t), compare_matches);
+  for (long i = 0; i < searcher->num_of_matches; i++) {
+    search_match_t* match = &searcher->matches[i];
+    fprintf(out, "%016lx: %s\n", match->addr, searcher->patterns[match->pattern].text);
+  }
+}
+
+void free_searcher (searcher_t* searcher){
+  for (int i = 0; i < searcher->num_of_patterns; i++) {
+    free(searcher->patterns[i].text);
+  }
+  free(searcher->patterns);
+  free(searcher->nodes);
+  free(searcher->matches);
+  memset(searcher, 0, sizeof(searcher_t));
+}
+
+
+static const char* skip_spaces (const char* s){
+  while (isspace((unsigned char) *s)) s++;
+  return s;
+}
+
+// parse a wildcard name at s and bind operand to it, adding the name to pattern if it is new
+static const char* parse_wildcard (const char* s, pattern_t* pattern, operand_pattern_t* operand){
+  char name[MAX_WILDCARD_NAME_LENGTH] = {0};
+  int len = 0;
+
+  if (!isalpha((unsigned char) *s) && *s != '_') return NULL;
+  while (isalnum((unsigned char) *s) || *s == '_') {
+    if (len == MAX_WILDCARD_NAME_LENGTH - 1) return NULL;
+    name[len++] = *s++;
+  }
+
+  int i;
+  for (i = 0; i < pattern->num_of_wildcards; i++) {
+    if (strcmp(pattern->wildcard_names[i], name) == 0) break;
+  }
+  if (i == pattern->num_of_wildcards) {
+    if (pattern->num_of_wildcards == MAX_WILDCARDS) return NULL;
+    strcpy(pattern->wildcard_names[i], name);
+    pattern->num_of_wildcards++;
+  }
+
+  operand->kind = OPERAND_WILDCARD;
+  operand->wildcard = i;
+  return s;
+}
+
+// parse a register (e.g. %rax) or a wildcard
+static const char* parse_reg_operand (const char* s, pattern_t* pattern, operand_pattern_t* operand){
+  if (s == NULL) return NULL;
+  s = skip_spaces(s);
+  if (*s != '%') return parse_wildcard(s, pattern, operand);
+
+  int len = 1;
+  while (isalnum((unsigned char) s[len])) len++;
+  for (uint8_t reg = 0; reg <= 0xE; reg++) {
+    const char* name = get_reg_name(reg);
+    if ((int) strlen(name) == len && strncmp(name, s, len) == 0) {
+      operand->kind = OPERAND_EXACT;
+      operand->value = reg;
+      return s + len;
+    }
+  }
+  return NULL;
+}
+
+// parse a number (optionally preceded by "$") or a wildcard
+static const char* parse_val_operand (const char* s, pattern_t* pattern, operand_pattern_t* operand){
+  if (s == NULL) return NULL;
+  s = skip_spaces(s);
+  if (*s == '$') s++;
+  if (!isdigit((unsigned char) *s)) return parse_wildcard(s, pattern, operand);
+
+  char* end;
+  operand->kind = OPERAND_EXACT;
+  operand->value = strtoull(s, &end, 0);
+  return end;
+}
+
+// parse a base displacement address D(reg); a missing D means 0
+static const char* parse_mem_operand (const char* s, pattern_t* pattern, operand_pattern_t* disp, operand_pattern_t* base){
+  if (s == NULL) return NULL;
+  s = skip_spaces(s);
+  if (*s == '(') {
+    disp->kind = OPERAND_EXACT;
+    disp->value = 0;
+  } else {
+    s = parse_val_operand(s, pattern, disp);
+  }
+  s = expect_char(s, '(');
+  s = parse_reg_operand(s, pattern, base);
+  return expect_char(s, ')');
+}
+
+static const char* expect_char (const char* s, char c){
+  if (s == NULL) return NULL;
+  s = skip_spaces(s);
+  return *s == c ? s + 1 : NULL;
+}
+
+// parse a single instruction of a pattern, return 0 on success or -1 if it is malformed
+static int parse_inst_pattern (const char* text, pattern_t* pattern, inst_pattern_t* inst_pattern){
+  const char* s = skip_spaces(text);
+  char mnemonic[8] = {0};
+  int len = 0;
+  while (isalpha((unsigned char) *s)) {
+    if (len == sizeof(mnemonic) - 1) return -1;
+    mnemonic[len++] = tolower((unsigned char) *s++);
+  }
+
+  int opcode;
+  for (opcode = 0; opcode < 256; opcode++) {
+    const char* name = get_opcode_name(opcode);
+    if (name != NULL && strcmp(name, mnemonic) == 0) break;
+  }
+  if (opcode == 256) return -1;
+
+  memset(inst_pattern, 0, sizeof(inst_pattern_t));
+  inst_pattern->opcode = opcode;
+
+  switch (opcode >> 4) {
+    case 0x0: case 0x1: case 0x9:               // halt, nop, ret
+        break;
+    case 0x2: case 0x6:                         // rrmovq/cmovXX, OPq
+        s = parse_reg_operand(s, pattern, &inst_pattern->ra);
+        s = expect_char(s, ',');
+        s = parse_reg_operand(s, pattern, &inst_pattern->rb);
+        break;
+    case 0x3:                                   // irmovq
+        s = parse_val_operand(s, pattern, &inst_pattern->imm_val);
+        s = expect_char(s, ',');
+        s = parse_reg_operand(s, pattern, &inst_pattern->rb);
+        break;
+    case 0x4:                                   // rmmovq
+        s = parse_reg_operand(s, pattern, &inst_pattern->ra);
+        s = expect_char(s, ',');
+        s = parse_mem_operand(s, pattern, &inst_pattern->imm_val, &inst_pattern->rb);
+        break;
+    case 0x5:                                   // mrmovq, rb is before ra in the assembly
+        s = parse_mem_operand(s, pattern, &inst_pattern->imm_val, &inst_pattern->rb);
+        s = expect_char(s, ',');
+        s = parse_reg_operand(s, pattern, &inst_pattern->ra);
+        break;
+    case 0x7: case 0x8:                         // jXX, call
+        s = parse_val_operand(s, pattern, &inst_pattern->imm_val);
+        break;
+    case 0xa: case 0xb:                         // pushq, popq
+        s = parse_reg_operand(s, pattern, &inst_pattern->ra);
+        break;
+  }
+
+  if (s == NULL) return -1;
+  s = skip_spaces(s);
+  return *s == '\0' ? 0 : -1;
+}
+
+// split line at ";" and parse each instruction into pattern
+static int parse_pattern (char* line, pattern_t* pattern){
+  char* inst_text = line;
+  while (inst_text != NULL) {
+    char* separator = strchr(inst_text, ';');
+    if (separator != NULL) *separator = '\0';
+
+    if (pattern->length == MAX_PATTERN_LENGTH) return -1;
+    if (parse_inst_pattern(inst_text, pattern, &pattern->insts[pattern->length]) != 0) return -1;
+    pattern->length++;
+
+    inst_text = separator != NULL ? separator + 1 : NULL;
+  }
+  pattern->next_at_same_node = -1;
+  return 0;
+}
+
+// build the trie of opcode sequences, then resolve failure links breadth first
+// so that every node has a transition on every opcode
+static int build_automaton (searcher_t* searcher){
+  if (add_node(searcher) != 0) return -1;
+
+  for (int p = 0; p < searcher->num_of_patterns; p++) {
+    pattern_t* pattern = &searcher->patterns[p];
+    int node = 0;
+    for (int i = 0; i < pattern->length; i++) {
+      uint8_t opcode = pattern->insts[i].opcode;
+      if (searcher->nodes[node].next[opcode] == -1) {
+        if (add_node(searcher) != 0) return -1;
+        searcher->nodes[node].next[opcode] = searcher->num_of_nodes - 1;
+      }
+      node = searcher->nodes[node].next[opcode];
+    }
+    pattern->next_at_same_node = searcher->nodes[node].first_pattern;
+    searcher->nodes[node].first_pattern = p;
+  }
+
+  int* queue = malloc(searcher->num_of_nodes * sizeof(int));
+  if (queue == NULL) {
+    printf("Out of memory while compiling patterns\n");
+    return -1;
+  }
+  int head = 0, tail = 0;
+
+  search_node_t* nodes = searcher->nodes;
+  for (int c = 0; c < 256; c++) {
+    if (nodes[0].next[c] == -1) {
+      nodes[0].next[c] = 0;
+    } else {
+      queue[tail++] = nodes[0].next[c];
+    }
+  }
+
+  while (head < tail) {
+    int u = queue[head++];
+    for (int c = 0; c < 256; c++) {
+      int v = nodes[u].next[c];
+      if (v == -1) {
+        nodes[u].next[c] = nodes[nodes[u].fail].next[c];
+      } else {
+        int fail = nodes[nodes[u].fail].next[c];
+        nodes[v].fail = fail;
+        nodes[v].output_link = nodes[fail].first_pattern != -1 ? fail : nodes[fail].output_link;
+        queue[tail++] = v;
+      }
+    }
+  }
+
+  free(queue);
+  return 0;
+}
+
+static int add_node (searcher_t* searcher){
+  search_node_t* nodes = realloc(searcher->nodes, (searcher->num_of_nodes + 1) * sizeof(search_node_t));
+  if (nodes == NULL) {
+    printf("Out of memory while compiling patterns\n");
+    return -1;
+  }
+  searcher->nodes = nodes;
+
+  search_node_t* node = &nodes[searcher->num_of_nodes++];
+  for (int c = 0; c < 256; c++) {
+    node->next[c] = -1;
+  }
+  node->fail = 0;
+  node->first_pattern = -1;
+  node->output_link = 0;
+  return 0;
+}
+
+// check the operands of the most recent instructions against pattern
+static int match_pattern (searcher_t* searcher, pattern_t* pattern){
+  uint64_t bound[MAX_WILDCARDS];
+  uint32_t is_bound = 0;
+
+  for (int i = 0; i < pattern->length; i++) {
+    int pos = (searcher->history_pos - (pattern->length - 1) + i + MAX_PATTERN_LENGTH) % MAX_PATTERN_LENGTH;
+    inst_t* inst = &searcher->history[pos];
+    inst_pattern_t* inst_pattern = &pattern->insts[i];
+
+    if (!match_operand(&inst_pattern->ra, inst->ra, bound, &is_bound)) return 0;
+    if (!match_operand(&inst_pattern->rb, inst->rb, bound, &is_bound)) return 0;
+    if (!match_operand(&inst_pattern->imm_val, inst->imm_val, bound, &is_bound)) return 0;
+  }
+  return 1;
+}
+
+static int match_operand (operand_pattern_t* operand, uint64_t value, uint64_t* bound, uint32_t* is_bound){
+  switch (operand->kind) {
+    case OPERAND_EXACT:
+        return operand->value == value;
+    case OPERAND_WILDCARD:
+        if (*is_bound & (1u << operand->wildcard)) {
+          return bound[operand->wildcard] == value;
+        }
+        bound[operand->wildcard] = value;
+        *is_bound |= 1u << operand->wildcard;
+        return 1;
+    default:
+        return 1;
+  }
+}
+
+static void add_match (searcher_t* searcher, y86_addr_t addr, int pattern){
+  if (searcher->num_of_matches == searcher->matches_capacity) {
+    long capacity = searcher->matches_capacity == 0 ? 64 : 2 * searcher->matches_capacity;
+    search_match_t* matches = realloc(searcher->matches, capacity * sizeof(search_match_t));
+    if (matches == NULL) {
+      printf("Out of memory, dropping match at 0x%lx\n", addr);
+      return;
+    }
+    searcher->matches = matches;
+    searcher->matches_capacity = capacity;
+  }
+  searcher->matches[searcher->num_of_matches].addr = addr;
+  searcher->matches[searcher->num_of_matches].pattern = pattern;
+  searcher->num_of_matches++;
+}
+
+// order matches by address, then by the order patterns appear in the pattern file
+static int compare_matches (const void* a, const void* b){
+  const search_match_t* x = a;
+  const search_match_t* y = b;
+  if (x->addr != y->addr) return x->addr < y->addr ? -1 : 1;
+  return x->pattern - y->pattern;
+}
@@ -0,0 +1,82 @@
+/* This file contains the prototypes and constants needed to use the
+   instruction-pattern search routines defined in searchRoutines.c
+*/
+
+#ifndef _SEARCHROUTINES_H_
+#define _SEARCHROUTINES_H_
+
+#include <stdio.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "printRoutines.h"
+
+#define MAX_PATTERN_LENGTH 16		// maximum number of instructions in a single pattern
+#define MAX_WILDCARDS 16			// maximum number of distinct wildcards in a single pattern
+#define MAX_WILDCARD_NAME_LENGTH 16
+#define MAX_PATTERN_LINE_LENGTH 512
+
+typedef enum operand_kind {
+	OPERAND_IGNORED, OPERAND_EXACT, OPERAND_WILDCARD
+} operand_kind_t;
+
+typedef struct {
+	operand_kind_t kind;
+	uint8_t wildcard;			// index of the wildcard bound to this operand
+	uint64_t value;				// value the operand must equal if kind is OPERAND_EXACT
+} operand_pattern_t;
+
+typedef struct {
+	uint8_t opcode;
+	operand_pattern_t ra;
+	operand_pattern_t rb;
+	operand_pattern_t imm_val;
+} inst_pattern_t;
+
+typedef struct {
+	char* text;					// pattern as written in the pattern file
+	int length;					// number of instructions in the pattern
+	inst_pattern_t insts[MAX_PATTERN_LENGTH];
+	int num_of_wildcards;
+	char wildcard_names[MAX_WILDCARDS][MAX_WILDCARD_NAME_LENGTH];
+	int next_at_same_node;		// next pattern ending at the same automaton node, or -1
+} pattern_t;
+
+typedef struct {
+	int next[256];				// transition on each opcode, failure links already resolved
+	int fail;
+	int first_pattern;			// first pattern ending at this node, or -1
+	int output_link;			// nearest node on the failure chain where a pattern ends, or 0
+} search_node_t;
+
+typedef struct {
+	y86_addr_t addr;			// address of the first instruction of the match
+	int pattern;
+} search_match_t;
+
+typedef struct {
+	pattern_t* patterns;
+	int num_of_patterns;
+	search_node_t* nodes;
+	int num_of_nodes;
+
+	// scanning state
+	int state;
+	y86_addr_t expected_addr;	// address right after the previously fed instruction
+	inst_t history[MAX_PATTERN_LENGTH];
+	y86_addr_t history_addr[MAX_PATTERN_LENGTH];
+	int history_pos;
+
+	search_match_t* matches;
+	long num_of_matches;
+	long matches_capacity;
+} searcher_t;
+
+int load_search_patterns (searcher_t* searcher, FILE* patternFile);
+void search_feed (searcher_t* searcher, inst_t inst, y86_addr_t currAddr);
+void print_search_matches (searcher_t* searcher, FILE* out);
+void free_searcher (searcher_t* searcher);
+
+
+#endif /* SEARCHROUTINES */
@@ -0,0 +1,357 @@
+#!/usr/bin/env python3
+# Checks for the disassembler, run with "make test" from the top directory.
+# Each check builds a small input image, runs ./disassemble on it and
+# compares the output with what is expected.
+
+import os
+import signal
+import subprocess
+import sys
+import tempfile
+import time
+
+DISASSEMBLE = os.path.abspath("disassemble")
+
+# inputs are never read as a whole, so reading a huge input must not take much
+# more memory than reading the tiny sample does
+MAX_RSS_GROWTH_KB = 16 * 1024
+
+failures = 0
+
+
+def run(args, workdir, offset=None):
+    """Run the disassembler, return (exit status, console output, output file text)."""
+    status, console, text, _ = run_measured(args, workdir, offset)
+    return status, console, text
+
+
+def run_measured(args, workdir, offset=None):
+    """Like run, but also return the peak resident memory of the run in KB.
+
+    The peak includes the memory of this script at the time it forks, so it is
+    only meaningful compared with another run, see check_memory.
+    """
+    out = os.path.join(workdir, "out.txt")
+    argv = [DISASSEMBLE] + args + [out] + ([offset] if offset is not None else [])
+    proc = subprocess.Popen(argv, stdout=subprocess.PIPE, universal_newlines=True)
+    console = proc.stdout.read()
+    proc.stdout.close()
+    _, wait_status, usage = os.wait4(proc.pid, 0)
+    proc.returncode = os.waitstatus_to_exitcode(wait_status)
+    text = ""
+    if os.path.exists(out):
+        with open(out) as f:
+            text = f.read()
+        os.remove(out)
+    return proc.returncode, console, text, usage.ru_maxrss
+
+
+def check(name, condition, detail=""):
+    global failures
+    if condition:
+        print("PASS %s" % name)
+    else:
+        failures += 1
+        print("FAIL %s" % name)
+        if detail:
+            print(detail)
+
+
+def write_file(workdir, name, data):
+    path = os.path.join(workdir, name)
+    mode = "wb" if isinstance(data, bytes) else "w"
+    with open(path, mode) as f:
+        f.write(data)
+    return path
+
+
+def test_sample(workdir):
+    status, _, text = run(["sample_input_binary_version.mem"], workdir)
+    with open("sample_output.txt") as f:
+        expected = f.read()
+    check("sample listing", status == 0 and text == expected)
+
+
+def test_search(workdir):
+    patterns = write_file(workdir, "sample.patterns", "\n".join([
+        "# the same wildcard name must match the same value",
+        "irmovq V, R; addq R, S",
+        "irmovq V, R; addq R, R",
+        # a D(reg) operand, found late but starting before the mrmovq match below
+        "xorq A, A; mrmovq X(%rdx), R; addq R, %rax",
+        "mrmovq X(B), R",
+        # these end at the same automaton node as the first pattern
+        "irmovq $0x8, %rbx; addq %rbx, S",
+        "irmovq $0x170, R; addq R, S",
+        "addq A, B",
+        "",
+    ]))
+    status, _, text = run(["--search", patterns, "sample_input_binary_version.mem"], workdir)
+    expected = [
+        "000000000000010a: xorq A, A; mrmovq X(%rdx), R; addq R, %rax",
+        "000000000000010c: mrmovq X(B), R",
+        "0000000000000116: addq A, B",
+        "0000000000000118: irmovq V, R; addq R, S",
+        "0000000000000118: irmovq $0x8, %rbx; addq %rbx, S",
+        "0000000000000122: addq A, B",
+    ]
+    check("search matches", status == 0 and text.splitlines() == expected, text)
+
+
+def test_summary(workdir):
+    # every count here was checked by hand against sample_output.txt
+    status, _, text = run(["--summary", "sample_input_binary_version.mem"], workdir)
+    expected = [
+        "Layout (376 bytes)",
+        "  code                60   16.0%",
+        "  .quad               48   12.8%",
+        "  .byte                0    0.0%",
+        "  zero               268   71.3%",
+        "",
+        "Instructions (12)",
+        "  halt                 2   16.7%",
+        "  nop                  0    0.0%",
+        "  ret                  1    8.3%",
+        "  cmovXX               0    0.0%",
+        "  irmovq               3   25.0%",
+        "  rmmovq               0    0.0%",
+        "  mrmovq               1    8.3%",
+        "  OPq                  4   33.3%",
+        "    addq               2   16.7%",
+        "    subq               1    8.3%",
+        "    xorq               1    8.3%",
+        "  jXX                  1    8.3%",
+        "    jne                1    8.3%",
+        "  call                 0    0.0%",
+        "  pushq                0    0.0%",
+        "  popq                 0    0.0%",
+        "",
+        "Instruction sizes",
+        "   1 bytes             3",
+        "   2 bytes             4",
+        "   9 bytes             1",
+        "  10 bytes             4",
+        "",
+        "Registers         reads       writes",
+        "  %rax               2            2",
+        "  %rcx               0            0",
+        "  %rdx               3            2",
+        "  %rbx               3            4",
+        "  %rsp               1            1",
+        "  %rbp               0            0",
+        "  %rsi               0            0",
+        "  %rdi               0            0",
+        "  %r8                0            0",
+        "  %r9                0            0",
+        "  %r10               0            0",
+        "  %r11               0            0",
+        "  %r12               0            0",
+        "  %r13               0            0",
+        "  %r14               0            0",
+        "",
+        "Largest zero-fill regions",
+        "  0000000000000000-00000000000000ff           256 bytes",
+        "  0000000000000171-0000000000000177             7 bytes",
+        "  000000000000013b-000000000000013f             5 bytes",
+        "",
+        "Largest invalid-byte clusters",
+        "  0000000000000140-000000000000016f            48 bytes",
+    ]
+    check("sample summary", status == 0 and text.splitlines() == expected, text)
+
+
+def test_trace_overlap(workdir):
+    # an irmovq at 0x15 overlaps the traced address 0x1e by 9 bytes, and one
+    # at 0x20 overlaps the traced address 0x23 by 3 bytes
+    image = (b"\x10" * 0x15 + bytes([0x30, 0xf1, 0x11, 0x22, 0x33, 0x44, 0x44, 0x44, 0x44])
+             + bytes([0x90, 0x10, 0x30, 0xf2, 0x55]) + bytes([0x90, 0x00]))
+    mem = write_file(workdir, "overlap.mem", image)
+    trace = write_file(workdir, "overlap.trace", "1e 3\n23\n")
+
+    status, _, text = run(["--trace", trace, mem], workdir)
+    lines = text.splitlines()
+    expected = [
+        "0000000000000015: 30f1112233444444      .quad 0x444444332211f130",
+        "000000000000001d: 44                    .byte 0x44",
+        "000000000000001e: 90                    ret                     # 3",
+        "000000000000001f: 10                    nop                     # 0",
+        "0000000000000020: 30                    .byte 0x30",
+        "0000000000000021: f2                    .byte 0xf2",
+        "0000000000000022: 55                    .byte 0x55",
+        "0000000000000023: 90                    ret                     # 1",
+    ]
+    check("trace overlap listing", status == 0 and lines[0x15:0x15 + len(expected)] == expected,
+          "\n".join(lines[0x15:0x15 + len(expected)]))
+
+
+def test_trace_conflict(workdir):
+    # 0x100 and 0x102 were both executed, but the irmovq at 0x100 covers 0x102
+    trace = write_file(workdir, "conflict.trace", "100\n102\n")
+    status, console, text = run(["--trace", trace, "sample_input_binary_version.mem"], workdir)
+    expected = [
+        "0000000000000100: 30                    .byte 0x30",
+        "0000000000000101: f2                    .byte 0xf2",
+        "0000000000000102: 40010000000000006300  rmmovq  %rax, 0x63000000000000(%rcx) # 1",
+        "000000000000010c: 50320000000000000000  mrmovq  0(%rdx), %rbx   # 0",
+    ]
+    check("trace conflict listing", status == 0 and text.splitlines()[:len(expected)] == expected,
+          "\n".join(text.splitlines()[:len(expected)]))
+    check("trace conflict reported",
+          "1 executed instructions overlap another executed address and are printed as data, first at 0x100" in console,
+          console)
+
+
+def test_ys_round_trip(workdir):
+    status, console, _ = run(["--ys", "sample_input_binary_version.mem"], workdir)
+    check("sample .ys round trip", status == 0 and ", 0 mismatches" in console, console)
+
+    # data split before a traced address is printed as .quad and .byte lines,
+    # and those lines must assemble back to the input bytes
+    image = b"\x10" * 0x15 + bytes([0x30, 0xf1, 0x11, 0x22, 0x33, 0x44, 0x44, 0x44, 0x44, 0x90, 0x00])
+    mem = write_file(workdir, "overlap.mem", image)
+    trace = write_file(workdir, "overlap.trace", "1e\n")
+    status, console, text = run(["--ys", "--trace", trace, mem], workdir)
+    check("trace overlap .ys round trip",
+          status == 0 and ", 0 mismatches" in console
+          and "    .quad 0x444444332211f130\n    .byte 0x44\n    ret\n" in text, console + text)
+
+    # the forward target 0x20 is labelled where it is printed, the backward
+    # target 0x1 only in the trailer
+    image = (bytes([0x10, 0x70, 0x20, 0, 0, 0, 0, 0, 0, 0]) + b"\x00" * 0x16
+             + bytes([0x74, 0x01, 0, 0, 0, 0, 0, 0, 0, 0x00]))
+    mem = write_file(workdir, "labels.mem", image)
+    status, console, text = run(["--ys", mem], workdir)
+    check("forward and backward .ys labels",
+          status == 0 and ", 0 mismatches" in console
+          and ".pos 0x20\nL20:\n    jne     L1\n" in text and text.endswith(".pos 0x1\nL1:\n")
+          and text.count("L1:") == 1 and text.count("L20:") == 1, console + text)
+
+
+def irmovq(value, reg):
+    return bytes([0x30, 0xf0 | reg]) + value.to_bytes(8, "little")
+
+
+def test_lint(workdir):
+    # one case per rule, then a zero irmovq that the irmovq/addq fold covers
+    image = (irmovq(0, 1) + bytes([0x10]) + bytes([0x20, 0x22]) + bytes([0xa0, 0x6f, 0xb0, 0x6f])
+             + bytes([0x40, 0x05]) + (8).to_bytes(8, "little") + bytes([0x50, 0x75]) + (8).to_bytes(8, "little")
+             + irmovq(0, 3) + bytes([0x60, 0x30]) + irmovq(5, 3) + bytes([0x60, 0x30]) + bytes([0x00]))
+    mem = write_file(workdir, "lint.mem", image)
+
+    status, _, text = run(["--lint-report", mem], workdir)
+    expected = [
+        "0000000000000000: zero-irmovq       xorq %rcx, %rcx if the condition codes are dead (saves 8 bytes, ~0 cycles)",
+        "000000000000000b: self-move         delete rrmovq %rdx, %rdx (saves 2 bytes, ~1 cycles)",
+        "000000000000000d: push-pop          delete pushq %rsi; popq %rsi (saves 4 bytes, ~2 cycles)",
+        "0000000000000011: store-load        rrmovq %rax, %rdi instead of reloading 0x8(%rbp) (saves 8 bytes, ~1 cycles)",
+        "0000000000000025: irmovq-addq-fold  irmovq $0x5, %rbx; addq %rbx, %rax if %rbx is dead afterwards (saves 12 bytes, ~2 cycles)",
+        "5 findings, 34 bytes and ~6 cycles could be saved",
+    ]
+    check("lint report", status == 0 and text.splitlines() == expected, text)
+
+    status, _, text = run(["--lint", mem], workdir)
+    lines = text.splitlines()
+    expected = [
+        "000000000000000f: b06f                  popq    %rsi",
+        "                                        # lint zero-irmovq at 0x0: xorq %rcx, %rcx if the condition codes are dead (saves 8 bytes, ~0 cycles)",
+        "                                        # lint self-move at 0xb: delete rrmovq %rdx, %rdx (saves 2 bytes, ~1 cycles)",
+        "                                        # lint push-pop at 0xd: delete pushq %rsi; popq %rsi (saves 4 bytes, ~2 cycles)",
+        "0000000000000011: 40050800000000000000  rmmovq  %rax, 0x8(%rbp)",
+        "000000000000001b: 50750800000000000000  mrmovq  0x8(%rbp), %rdi",
+        "                                        # lint store-load at 0x11: rrmovq %rax, %rdi instead of reloading 0x8(%rbp) (saves 8 bytes, ~1 cycles)",
+        "0000000000000025: 30f30000000000000000  irmovq  $0, %rbx",
+        "000000000000002f: 6030                  addq    %rbx, %rax",
+        "0000000000000031: 30f30500000000000000  irmovq  $0x5, %rbx",
+        "000000000000003b: 6030                  addq    %rbx, %rax",
+        "                                        # lint irmovq-addq-fold at 0x25: irmovq $0x5, %rbx; addq %rbx, %rax if %rbx is dead afterwards (saves 12 bytes, ~2 cycles)",
+        "000000000000003d: 00                    halt    ",
+        "# lint: 5 findings, 34 bytes and ~6 cycles could be saved",
+    ]
+    check("lint listing", status == 0 and lines[4:] == expected, text)
+
+
+def check_memory(name, rss, workdir):
+    _, _, _, baseline = run_measured(["sample_input_binary_version.mem"], workdir)
+    check("%s memory (%d KB, %d KB on the sample)" % (name, rss, baseline), rss - baseline < MAX_RSS_GROWTH_KB)
+
+
+def test_huge_sparse_image(workdir):
+    # the sample code at its usual place and again above 4GB, in a 6GB sparse file
+    high_offset = 5 * 2**30 + 0x123
+    with open("sample_input_binary_version.mem", "rb") as f:
+        code = f.read()
+    mem = os.path.join(workdir, "huge.mem")
+    with open(mem, "wb") as f:
+        f.write(code)
+        f.seek(high_offset)
+        f.write(code)
+        f.truncate(6 * 2**30)
+
+    with open("sample_output.txt") as f:
+        low = f.read().splitlines()
+    high = ["%016x%s" % (int(line[:16], 16) + high_offset, line[16:]) for line in low]
+
+    status, _, text, rss = run_measured([mem], workdir)
+    check("sparse 6GB listing", status == 0 and text.splitlines() == low + high)
+    check_memory("sparse 6GB listing", rss, workdir)
+
+    status, _, text = run([mem], workdir, "%#x" % (4 * 2**30))
+    check("sparse 6GB listing from an offset above 4GB", status == 0 and text.splitlines() == high)
+
+    status, console, text, rss = run_measured(["--ys", mem], workdir)
+    check("sparse 6GB .ys round trip", status == 0 and ", 0 mismatches" in console
+          and ".pos %#x\n" % (high_offset + 0x100) in text, console)
+    check_memory("sparse 6GB .ys", rss, workdir)
+    os.remove(mem)
+
+
+def test_huge_dense_image(workdir):
+    # 256MB of data after a 4GB hole, every byte of it has to be read
+    mem = os.path.join(workdir, "dense.mem")
+    with open(mem, "wb") as f:
+        f.seek(4 * 2**30)
+        chunk = os.urandom(2**20)
+        for _ in range(256):
+            f.write(chunk)
+
+    status, _, text, rss = run_measured(["--summary", mem], workdir)
+    check("dense 4.25GB summary", status == 0 and "Layout (%d bytes)" % (4 * 2**30 + 256 * 2**20) in text)
+    check_memory("dense 4.25GB summary", rss, workdir)
+
+    # the input shrinks while it is being read: this is a read error, not the end of the input
+    out = os.path.join(workdir, "out.txt")
+    proc = subprocess.Popen([DISASSEMBLE, "--summary", mem, out], stdout=subprocess.PIPE, universal_newlines=True)
+    time.sleep(0.1)
+    proc.send_signal(signal.SIGSTOP)
+    os.truncate(mem, 4 * 2**30 + 16 * 2**20)
+    proc.send_signal(signal.SIGCONT)
+    try:
+        console, _ = proc.communicate(timeout=60)
+    except subprocess.TimeoutExpired:
+        proc.kill()
+        console, _ = proc.communicate()
+    check("input truncated while reading", proc.returncode not in (0, None) and "Failed to read" in console
+          and "Input/output error" in console, console)
+    os.remove(mem)
+
+
+def main():
+    if not os.path.exists(DISASSEMBLE):
+        print("%s not found, run make first" % DISASSEMBLE)
+        return 1
+    with tempfile.TemporaryDirectory() as workdir:
+        test_sample(workdir)
+        test_search(workdir)
+        test_summary(workdir)
+        test_trace_overlap(workdir)
+        test_trace_conflict(workdir)
+        test_ys_round_trip(workdir)
+        test_lint(workdir)
+        test_huge_sparse_image(workdir)
+        test_huge_dense_image(workdir)
+    print("%d checks failed" % failures if failures else "All checks passed")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,363 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "traceRoutines.h"
+
+/*********************************************************************
+   Execution traces.
+
+   A trace file lists the PCs executed by a simulator run, one per
+   line, in hex (with or without a leading 0x), each optionally
+   followed by a decimal execution count (1 if omitted). The same PC
+   may appear any number of times; the counts are added up. Blank lines
+   and lines starting with "#" are ignored.
+
+   Traces can be far larger than memory, so they are read in chunks of
+   TRACE_CHUNK_ENTRIES entries. Each chunk is sorted and deduplicated
+   and, if there is more than one, written to a temporary file as a
+   sorted run. The runs are then merged through a heap one entry at a
+   time while the disassembler walks the input in address order, so
+   memory use does not depend on the length of the trace.
+
+   To keep the number of open temporary files small, whenever the last
+   TRACE_MERGE_WIDTH runs have the same level they are merged into a
+   single run of the next level while the trace is still being read.
+   At most TRACE_MERGE_WIDTH - 1 runs of each level remain, so a trace
+   of a billion entries is kept in fewer than 50 files.
+********************************************************************************/
+
+static int compare_entries (const void* a, const void* b);
+static long sort_and_dedup (trace_entry_t* entries, long num_of_entries);
+static int spill_run (trace_t* trace, long num_of_entries);
+static int add_run (trace_t* trace, FILE* run, int level);
+static int merge_last_runs (trace_t* trace);
+static int alloc_merge_heap (trace_t* trace);
+static void start_merge (trace_t* trace, int first_run);
+static void rewind_trace (trace_t* trace);
+static void sift_down (trace_t* trace, int i);
+static int next_merged_entry (trace_t* trace, trace_entry_t* entry);
+static void end_block (hot_blocks_t* hot_blocks);
+
+
+// read the whole trace file and prepare to walk it in address order
+// return 0 on success, or -1 (after printing the reason) on failure
+int load_trace (trace_t* trace, FILE* traceFile){
+  char line[MAX_TRACE_LINE_LENGTH];
+  long line_num = 0;
+  long num_of_entries = 0;
+
+  memset(trace, 0, sizeof(trace_t));
+  trace->entries = malloc(TRACE_CHUNK_ENTRIES * sizeof(trace_entry_t));
+  if (trace->entries == NULL) {
+    printf("Out of memory while loading trace\n");
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), traceFile) != NULL) {
+    line_num++;
+    char* s = line;
+    while (isspace((unsigned char) *s)) s++;
+    if (*s == '\0' || *s == '#') continue;
+
+    char* end;
+    trace_entry_t* entry = &trace->entries[num_of_entries];
+    entry->pc = strtoull(s, &end, 16);
+    if (end == s) {
+      printf("Invalid trace entry on line %ld: %s", line_num, line);
+      return -1;
+    }
+    s = end;
+    entry->count = strtol(s, &end, 10);
+    if (end == s) {
+      entry->count = 1;
+    }
+
+    if (++num_of_entries == TRACE_CHUNK_ENTRIES) {
+      num_of_entries = sort_and_dedup(trace->entries, num_of_entries);
+      if (spill_run(trace, num_of_entries) != 0) return -1;
+      num_of_entries = 0;
+    }
+  }
+
+  num_of_entries = sort_and_dedup(trace->entries, num_of_entries);
+  if (trace->num_of_runs == 0) {
+    // the whole trace fits in memory
+    trace->num_of_entries = num_of_entries;
+  } else {
+    if (num_of_entries > 0 && spill_run(trace, num_of_entries) != 0) return -1;
+    free(trace->entries);
+    trace->entries = NULL;
+    if (alloc_merge_heap(trace) != 0) return -1;
+  }
+
+  rewind_trace(trace);
+  return 0;
+}
+
+// start walking the trace from the lowest pc
+static void rewind_trace (trace_t* trace){
+  trace->pos = 0;
+  start_merge(trace, 0);
+  trace->has_current = next_merged_entry(trace, &trace->current);
+}
+
+// drop every traced pc below addr, leaving the smallest pc >= addr (if any) in trace->current
+void trace_skip_to (trace_t* trace, y86_addr_t addr){
+  while (trace->has_current && trace->current.pc < addr) {
+    trace->has_current = next_merged_entry(trace, &trace->current);
+  }
+}
+
+void free_trace (trace_t* trace){
+  for (int r = 0; r < trace->num_of_runs; r++) {
+    fclose(trace->runs[r]);
+  }
+  free(trace->runs);
+  free(trace->run_levels);
+  free(trace->heads);
+  free(trace->heap);
+  free(trace->entries);
+  memset(trace, 0, sizeof(trace_t));
+}
+
+
+void init_hot_blocks (hot_blocks_t* hot_blocks){
+  memset(hot_blocks, 0, sizeof(hot_blocks_t));
+}
+
+// add the instruction at currAddr, executed count times, to the current block
+// a block ends at a control transfer, at data, at a gap in the addresses, or where
+// the execution count changes (which means control entered or left in the middle)
+void hot_blocks_feed (hot_blocks_t* hot_blocks, inst_t inst, y86_addr_t currAddr, long count){
+  hot_block_t* block = &hot_blocks->current;
+
+  if (block->num_of_insts > 0 && (block->end != currAddr || hot_blocks->last_count != count)) {
+    end_block(hot_blocks);
+  }
+  if (inst.type == INVALID) {
+    end_block(hot_blocks);
+    return;
+  }
+
+  if (block->num_of_insts == 0) {
+    block->start = currAddr;
+    block->entry_count = count;
+  }
+  block->end = currAddr + inst.size;
+  block->num_of_insts++;
+  block->executed += count;
+  hot_blocks->last_count = count;
+
+  switch (inst.type) {
+    case JXX: case CALL: case RET: case HALT:
+        end_block(hot_blocks);
+        break;
+    default:
+        break;
+  }
+}
+
+// print the hottest blocks as comments so the listing stays reassemblable
+void print_hot_blocks (hot_blocks_t* hot_blocks, FILE* out){
+  end_block(hot_blocks);
+
+  fprintf(out, "# Hottest blocks\n");
+  fprintf(out, "#   %-16s  %-16s  %8s  %12s  %14s\n", "start", "end", "insts", "entries", "executed");
+  for (int i = 0; i < NUM_OF_HOT_BLOCKS && hot_blocks->hottest[i].executed > 0; i++) {
+    hot_block_t* block = &hot_blocks->hottest[i];
+    fprintf(out, "#   %016lx  %016lx  %8ld  %12ld  %14ld\n",
+            block->start, block->end, block->num_of_insts, block->entry_count, block->executed);
+  }
+}
+
+
+static int compare_entries (const void* a, const void* b){
+  const trace_entry_t* x = a;
+  const trace_entry_t* y = b;
+  if (x->pc != y->pc) return x->pc < y->pc ? -1 : 1;
+  return 0;
+}
+
+// sort entries by pc and merge entries with the same pc, return the new number of entries
+static long sort_and_dedup (trace_entry_t* entries, long num_of_entries){
+  if (num_of_entries == 0) return 0;
+  qsort(entries, num_of_entries, sizeof(trace_entry_t), compare_entries);
+
+  long unique = 0;
+  for (long i = 1; i < num_of_entries; i++) {
+    if (entries[i].pc == entries[unique].pc) {
+      entries[unique].count += entries[i].count;
+    } else {
+      entries[++unique] = entries[i];
+    }
+  }
+  return unique + 1;
+}
+
+// write the sorted chunk in trace->entries to a new temporary file
+static int spill_run (trace_t* trace, long num_of_entries){
+  FILE* run = tmpfile();
+  if (run == NULL) {
+    perror("Failed to create temporary file for trace");
+    return -1;
+  }
+  if (add_run(trace, run, 0) != 0) return -1;
+
+  if (fwrite(trace->entries, sizeof(trace_entry_t), num_of_entries, run) != (size_t) num_of_entries) {
+    perror("Failed to write temporary file for trace");
+    return -1;
+  }
+
+  // levels never increase along the runs, so the last TRACE_MERGE_WIDTH runs
+  // have the same level exactly when the first and the last of them do
+  while (trace->num_of_runs >= TRACE_MERGE_WIDTH &&
+         trace->run_levels[trace->num_of_runs - TRACE_MERGE_WIDTH] == trace->run_levels[trace->num_of_runs - 1]) {
+    if (merge_last_runs(trace) != 0) return -1;
+  }
+  return 0;
+}
+
+// append run to the runs of trace (closing it on failure)
+static int add_run (trace_t* trace, FILE* run, int level){
+  FILE** runs = realloc(trace->runs, (trace->num_of_runs + 1) * sizeof(FILE*));
+  if (runs != NULL) {
+    trace->runs = runs;
+  }
+  int* run_levels = realloc(trace->run_levels, (trace->num_of_runs + 1) * sizeof(int));
+  if (run_levels != NULL) {
+    trace->run_levels = run_levels;
+  }
+  if (runs == NULL || run_levels == NULL) {
+    fclose(run);
+    printf("Out of memory while loading trace\n");
+    return -1;
+  }
+
+  trace->runs[trace->num_of_runs] = run;
+  trace->run_levels[trace->num_of_runs] = level;
+  trace->num_of_runs++;
+  return 0;
+}
+
+// replace the last TRACE_MERGE_WIDTH runs by a single run of the next level
+static int merge_last_runs (trace_t* trace){
+  int first_run = trace->num_of_runs - TRACE_MERGE_WIDTH;
+  int level = trace->run_levels[first_run] + 1;
+
+  FILE* merged = tmpfile();
+  if (merged == NULL) {
+    perror("Failed to create temporary file for trace");
+    return -1;
+  }
+  if (alloc_merge_heap(trace) != 0) {
+    fclose(merged);
+    return -1;
+  }
+
+  start_merge(trace, first_run);
+  trace_entry_t entry;
+  while (next_merged_entry(trace, &entry)) {
+    if (fwrite(&entry, sizeof(trace_entry_t), 1, merged) != 1) {
+      perror("Failed to write temporary file for trace");
+      fclose(merged);
+      return -1;
+    }
+  }
+
+  for (int r = first_run; r < trace->num_of_runs; r++) {
+    fclose(trace->runs[r]);
+  }
+  trace->num_of_runs = first_run;
+  return add_run(trace, merged, level);
+}
+
+// make room in the merge heap for every run
+static int alloc_merge_heap (trace_t* trace){
+  trace_entry_t* heads = realloc(trace->heads, trace->num_of_runs * sizeof(trace_entry_t));
+  if (heads != NULL) {
+    trace->heads = heads;
+  }
+  int* heap = realloc(trace->heap, trace->num_of_runs * sizeof(int));
+  if (heap != NULL) {
+    trace->heap = heap;
+  }
+  if (heads == NULL || heap == NULL) {
+    printf("Out of memory while loading trace\n");
+    return -1;
+  }
+  return 0;
+}
+
+// rewind the runs from first_run on and order them in the heap by their first entry
+static void start_merge (trace_t* trace, int first_run){
+  trace->heap_size = 0;
+  for (int r = first_run; r < trace->num_of_runs; r++) {
+    rewind(trace->runs[r]);
+    if (fread(&trace->heads[r], sizeof(trace_entry_t), 1, trace->runs[r]) == 1) {
+      trace->heap[trace->heap_size++] = r;
+    }
+  }
+  for (int i = trace->heap_size / 2 - 1; i >= 0; i--) {
+    sift_down(trace, i);
+  }
+}
+
+static void sift_down (trace_t* trace, int i){
+  int* heap = trace->heap;
+  for (;;) {
+    int smallest = i;
+    int left = 2 * i + 1;
+    int right = left + 1;
+    if (left < trace->heap_size && trace->heads[heap[left]].pc < trace->heads[heap[smallest]].pc) smallest = left;
+    if (right < trace->heap_size && trace->heads[heap[right]].pc < trace->heads[heap[smallest]].pc) smallest = right;
+    if (smallest == i) return;
+    int tmp = heap[i];
+    heap[i] = heap[smallest];
+    heap[smallest] = tmp;
+    i = smallest;
+  }
+}
+
+// store the next (pc, total count) in address order to entry, return 0 if the trace is exhausted
+static int next_merged_entry (trace_t* trace, trace_entry_t* entry){
+  if (trace->num_of_runs == 0) {
+    if (trace->pos == trace->num_of_entries) return 0;
+    *entry = trace->entries[trace->pos++];
+    return 1;
+  }
+
+  if (trace->heap_size == 0) return 0;
+  entry->pc = trace->heads[trace->heap[0]].pc;
+  entry->count = 0;
+
+  // pop every run whose next entry has this pc (runs are deduplicated, so each contributes at most once)
+  while (trace->heap_size > 0 && trace->heads[trace->heap[0]].pc == entry->pc) {
+    int r = trace->heap[0];
+    entry->count += trace->heads[r].count;
+    if (fread(&trace->heads[r], sizeof(trace_entry_t), 1, trace->runs[r]) != 1) {
+      trace->heap[0] = trace->heap[--trace->heap_size];
+    }
+    sift_down(trace, 0);
+  }
+  return 1;
+}
+
+// move the current block into the hottest blocks if it is hot enough
+static void end_block (hot_blocks_t* hot_blocks){
+  hot_block_t* block = &hot_blocks->current;
+  if (block->num_of_insts == 0) return;
+
+  int i = NUM_OF_HOT_BLOCKS;
+  while (i > 0 && hot_blocks->hottest[i-1].executed < block->executed) {
+    if (i < NUM_OF_HOT_BLOCKS) {
+      hot_blocks->hottest[i] = hot_blocks->hottest[i-1];
+    }
+    i--;
+  }
+  if (i < NUM_OF_HOT_BLOCKS) {
+    hot_blocks->hottest[i] = *block;
+  }
+
+  memset(block, 0, sizeof(hot_block_t));
+}
@@ -0,0 +1,68 @@
+/* This file contains the prototypes and constants needed to use the
+   execution trace routines defined in traceRoutines.c
+*/
+
+#ifndef _TRACEROUTINES_H_
+#define _TRACEROUTINES_H_
+
+#include <stdio.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "printRoutines.h"
+
+#define TRACE_CHUNK_ENTRIES (1 << 20)	// trace entries sorted in memory at a time
+#define TRACE_MERGE_WIDTH 16			// sorted runs merged into one as soon as there are this many of the same level
+#define MAX_TRACE_LINE_LENGTH 128
+#define NUM_OF_HOT_BLOCKS 10
+#define TRACE_COUNT_COLUMN 64			// column where execution counts are printed
+
+typedef struct {
+	y86_addr_t pc;
+	long count;
+} trace_entry_t;
+
+typedef struct {
+	// if the whole trace fits in one chunk it stays in memory, otherwise
+	// it is spilled to sorted runs in temporary files and merged lazily
+	trace_entry_t* entries;
+	long num_of_entries;
+	long pos;
+
+	FILE** runs;
+	int* run_levels;			// number of merges each run went through, never increasing along runs
+	int num_of_runs;
+	trace_entry_t* heads;		// next entry of each run
+	int* heap;					// runs ordered by the pc of their next entry
+	int heap_size;
+
+	// smallest traced pc not yet skipped over
+	int has_current;
+	trace_entry_t current;
+} trace_t;
+
+typedef struct {
+	y86_addr_t start;
+	y86_addr_t end;				// address right after the last instruction
+	long num_of_insts;
+	long entry_count;			// execution count of the first instruction
+	long executed;				// total number of instructions executed in the block
+} hot_block_t;
+
+typedef struct {
+	hot_block_t hottest[NUM_OF_HOT_BLOCKS];		// sorted by executed, hottest first
+	hot_block_t current;
+	long last_count;
+} hot_blocks_t;
+
+int load_trace (trace_t* trace, FILE* traceFile);
+void trace_skip_to (trace_t* trace, y86_addr_t addr);
+void free_trace (trace_t* trace);
+
+void init_hot_blocks (hot_blocks_t* hot_blocks);
+void hot_blocks_feed (hot_blocks_t* hot_blocks, inst_t inst, y86_addr_t currAddr, long count);
+void print_hot_blocks (hot_blocks_t* hot_blocks, FILE* out);
+
+
+#endif /* TRACEROUTINES */
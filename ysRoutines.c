@@ -0,0 +1,349 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "ysRoutines.h"
+
+/*********************************************************************
+   Reassemblable .ys output.
+
+   Every item is printed without its address, in a single pass over
+   the input: a ".pos" directive wherever the addresses are not
+   contiguous (the starting offset and skipped zero bytes), jumps and
+   calls to labels instead of numbers, and invalid instructions as
+   .quad/.byte data. Labels are named after the address they stand for,
+   so a target does not have to be known before its address is reached.
+   A forward target gets its label right before the item at its
+   address. Backward targets, and targets that do not start an item,
+   get their label at the end of the output with its own ".pos".
+
+   Every line printed for an item is assembled again from its text
+   (mnemonic, registers, immediates and label names, data values) and
+   compared with the input bytes at the location the assembler would
+   put it. If the output is assembled, the object code therefore
+   matches the input. A label is taken to stand for the address in its
+   name; that holds because each label is placed right before the item
+   at that address, or after a ".pos" to it in the trailer.
+********************************************************************************/
+
+static int compare_addrs (const void* a, const void* b);
+static void add_addr (ys_writer_t* ys, addr_list_t* list, y86_addr_t addr);
+static void push_pending (ys_writer_t* ys, y86_addr_t addr);
+static void pop_pending (ys_writer_t* ys);
+static int is_defined (ys_writer_t* ys, y86_addr_t addr);
+static void emit_line (ys_writer_t* ys, const char* text, y86_addr_t addr, const uint8_t* bytes, int size, FILE* out);
+static int assemble_line (const char* text, uint8_t* buffer);
+static const char* parse_reg (const char* s, uint8_t* reg);
+static const char* parse_number (const char* s, uint64_t* val);
+static const char* parse_label (const char* s, uint64_t* val);
+static const char* expect_char (const char* s, char c);
+
+
+void init_ys_writer (ys_writer_t* ys){
+  memset(ys, 0, sizeof(ys_writer_t));
+  ys->expected_addr = INVALID_ADDR;
+  ys->first_mismatch = INVALID_ADDR;
+}
+
+// print the item at currAddr to out file and check that the printed text assembles back to its bytes
+void ys_emit (ys_writer_t* ys, inst_t inst, y86_addr_t currAddr, FILE* out){
+  if (currAddr != ys->expected_addr) {
+    fprintf(out, "%s.pos %#lx\n", ys->expected_addr == INVALID_ADDR ? "" : "\n", currAddr);
+    ys->location = currAddr;
+  }
+  ys->expected_addr = currAddr + inst.size;
+
+  // forward targets passed without reaching them are in the middle of an item or skipped
+  while (ys->pending.num_of_addrs > 0 && ys->pending.addrs[0] < currAddr) {
+    add_addr(ys, &ys->trailer, ys->pending.addrs[0]);
+    pop_pending(ys);
+  }
+  if (ys->pending.num_of_addrs > 0 && ys->pending.addrs[0] == currAddr) {
+    fprintf(out, "L%lx:\n", currAddr);
+    add_addr(ys, &ys->defined, currAddr);
+    while (ys->pending.num_of_addrs > 0 && ys->pending.addrs[0] == currAddr) {
+      pop_pending(ys);
+    }
+  }
+
+  if (inst.type == JXX || inst.type == CALL) {
+    if (inst.imm_val > currAddr) {
+      push_pending(ys, inst.imm_val);
+    } else if (!is_defined(ys, inst.imm_val)) {
+      add_addr(ys, &ys->trailer, inst.imm_val);
+    }
+  }
+
+  char line[MAX_ASSEMBLY_LENGTH];
+  if (inst.type == INVALID) {
+    if (inst.size == 8) {
+      sprintf(line, ".quad %#lx", inst.imm_val);
+      emit_line(ys, line, currAddr, inst.bytes, 8, out);
+    } else {
+      for (int i = 0; i < inst.size; i++) {
+        sprintf(line, ".byte %#x", inst.bytes[i]);
+        emit_line(ys, line, currAddr + i, inst.bytes + i, 1, out);
+      }
+    }
+  } else if (inst.type == JXX || inst.type == CALL) {
+    sprintf(line, "%-8sL%lx", get_opcode_name(inst.opcode), inst.imm_val);
+    emit_line(ys, line, currAddr, inst.bytes, inst.size, out);
+  } else {
+    get_inst_assembly(line, inst);
+    // drop the padding after mnemonics without operands
+    int len = strlen(line);
+    while (len > 0 && line[len-1] == ' ') {
+      line[--len] = '\0';
+    }
+    emit_line(ys, line, currAddr, inst.bytes, inst.size, out);
+  }
+}
+
+// define the labels not placed before an item
+// return 0 on success, or -1 (after printing the reason) if out of memory
+int ys_end_emitting (ys_writer_t* ys, FILE* out){
+  // forward targets never reached lie past the end of the input
+  while (ys->pending.num_of_addrs > 0) {
+    add_addr(ys, &ys->trailer, ys->pending.addrs[0]);
+    pop_pending(ys);
+  }
+  if (ys->out_of_memory) {
+    printf("Out of memory while collecting jump targets\n");
+    return -1;
+  }
+
+  addr_list_t* trailer = &ys->trailer;
+  if (trailer->num_of_addrs > 0) {
+    qsort(trailer->addrs, trailer->num_of_addrs, sizeof(y86_addr_t), compare_addrs);
+  }
+  int first = 1;
+  for (long i = 0; i < trailer->num_of_addrs; i++) {
+    y86_addr_t target = trailer->addrs[i];
+    if ((i > 0 && target == trailer->addrs[i-1]) || is_defined(ys, target)) continue;
+    if (first) {
+      fprintf(out, "\n# targets that are reached backwards or do not start an item\n");
+      first = 0;
+    }
+    fprintf(out, ".pos %#lx\nL%lx:\n", target, target);
+  }
+  return 0;
+}
+
+void free_ys_writer (ys_writer_t* ys){
+  free(ys->pending.addrs);
+  free(ys->defined.addrs);
+  free(ys->trailer.addrs);
+  memset(ys, 0, sizeof(ys_writer_t));
+}
+
+
+static int compare_addrs (const void* a, const void* b){
+  y86_addr_t x = *(const y86_addr_t*) a;
+  y86_addr_t y = *(const y86_addr_t*) b;
+  if (x != y) return x < y ? -1 : 1;
+  return 0;
+}
+
+// append addr to list, or remember that memory ran out
+static void add_addr (ys_writer_t* ys, addr_list_t* list, y86_addr_t addr){
+  if (ys->out_of_memory) return;
+
+  if (list->num_of_addrs == list->capacity) {
+    long capacity = list->capacity == 0 ? 64 : 2 * list->capacity;
+    y86_addr_t* addrs = realloc(list->addrs, capacity * sizeof(y86_addr_t));
+    if (addrs == NULL) {
+      ys->out_of_memory = 1;
+      return;
+    }
+    list->addrs = addrs;
+    list->capacity = capacity;
+  }
+  list->addrs[list->num_of_addrs++] = addr;
+}
+
+// add a forward target to the min-heap of pending targets
+static void push_pending (ys_writer_t* ys, y86_addr_t addr){
+  addr_list_t* heap = &ys->pending;
+  long before = heap->num_of_addrs;
+  add_addr(ys, heap, addr);
+  if (heap->num_of_addrs == before) return;
+
+  long i = heap->num_of_addrs - 1;
+  while (i > 0 && heap->addrs[(i - 1) / 2] > heap->addrs[i]) {
+    y86_addr_t tmp = heap->addrs[i];
+    heap->addrs[i] = heap->addrs[(i - 1) / 2];
+    heap->addrs[(i - 1) / 2] = tmp;
+    i = (i - 1) / 2;
+  }
+}
+
+// remove the smallest pending target
+static void pop_pending (ys_writer_t* ys){
+  addr_list_t* heap = &ys->pending;
+  heap->addrs[0] = heap->addrs[--heap->num_of_addrs];
+
+  long i = 0;
+  for (;;) {
+    long smallest = i;
+    long left = 2 * i + 1;
+    long right = left + 1;
+    if (left < heap->num_of_addrs && heap->addrs[left] < heap->addrs[smallest]) smallest = left;
+    if (right < heap->num_of_addrs && heap->addrs[right] < heap->addrs[smallest]) smallest = right;
+    if (smallest == i) return;
+    y86_addr_t tmp = heap->addrs[i];
+    heap->addrs[i] = heap->addrs[smallest];
+    heap->addrs[smallest] = tmp;
+    i = smallest;
+  }
+}
+
+// whether a label for addr was placed before an item (labels are placed in address order)
+static int is_defined (ys_writer_t* ys, y86_addr_t addr){
+  if (ys->defined.num_of_addrs == 0) return 0;
+  return bsearch(&addr, ys->defined.addrs, ys->defined.num_of_addrs, sizeof(y86_addr_t), compare_addrs) != NULL;
+}
+
+// print one line of the output, assemble it again and compare the result with the
+// size input bytes at bytes, which the line stands for at address addr
+static void emit_line (ys_writer_t* ys, const char* text, y86_addr_t addr, const uint8_t* bytes, int size, FILE* out){
+  fprintf(out, "    %s\n", text);
+
+  uint8_t assembled[10];
+  int assembled_size = assemble_line(text, assembled);
+  if (ys->location != addr || assembled_size != size || memcmp(assembled, bytes, size) != 0) {
+    if (ys->num_of_mismatches == 0) {
+      ys->first_mismatch = addr;
+    }
+    ys->num_of_mismatches++;
+  }
+
+  ys->location += assembled_size > 0 ? assembled_size : size;
+  ys->bytes_verified += size;
+}
+
+// assemble one line of the output the way the assembler would
+// return the number of bytes stored in buffer, or -1 if the line is not valid assembly
+static int assemble_line (const char* text, uint8_t* buffer){
+  char mnemonic[16];
+  int len = 0;
+  while (text[len] != '\0' && !isspace((unsigned char) text[len]) && len < (int) sizeof(mnemonic) - 1) {
+    mnemonic[len] = text[len];
+    len++;
+  }
+  mnemonic[len] = '\0';
+  const char* s = text + len;
+  uint64_t val = 0;
+
+  if (strcmp(mnemonic, ".quad") == 0 || strcmp(mnemonic, ".byte") == 0) {
+    int size = strcmp(mnemonic, ".quad") == 0 ? 8 : 1;
+    s = expect_char(parse_number(s, &val), '\0');
+    if (s == NULL || (size == 1 && val > 0xFF)) return -1;
+    for (int i = 0; i < size; i++) {
+      buffer[i] = val >> (8 * i) & 0xFF;
+    }
+    return size;
+  }
+
+  int opcode = -1;
+  for (int op = 0; op < 256 && opcode == -1; op++) {
+    const char* name = get_opcode_name(op);
+    if (name != NULL && strcmp(name, mnemonic) == 0) {
+      opcode = op;
+    }
+  }
+
+  uint8_t ra = 0xF;
+  uint8_t rb = 0xF;
+  int size;
+  switch (opcode >> 4) {
+    case 0x0: case 0x1: case 0x9:
+        size = 1;
+        break;
+    case 0x2: case 0x6:
+        s = parse_reg(expect_char(parse_reg(s, &ra), ','), &rb);
+        size = 2;
+        break;
+    case 0xA: case 0xB:
+        s = parse_reg(s, &ra);
+        size = 2;
+        break;
+    case 0x3:
+        s = parse_reg(expect_char(parse_number(expect_char(s, '$'), &val), ','), &rb);
+        size = 10;
+        break;
+    case 0x4:
+        s = parse_number(expect_char(parse_reg(s, &ra), ','), &val);
+        s = expect_char(parse_reg(expect_char(s, '('), &rb), ')');
+        size = 10;
+        break;
+    case 0x5:
+        s = expect_char(parse_reg(expect_char(parse_number(s, &val), '('), &rb), ')');
+        s = parse_reg(expect_char(s, ','), &ra);
+        size = 10;
+        break;
+    case 0x7: case 0x8:
+        s = parse_label(s, &val);
+        size = 9;
+        break;
+    default:
+        // unknown mnemonic (opcode is -1)
+        return -1;
+  }
+  if (expect_char(s, '\0') == NULL) return -1;
+
+  buffer[0] = opcode;
+  int pos = 1;
+  if (size == 2 || size == 10) {
+    buffer[pos++] = ra << 4 | rb;
+  }
+  for (int i = 0; pos < size; i++) {
+    buffer[pos++] = val >> (8 * i) & 0xFF;
+  }
+  return size;
+}
+
+// each parser skips leading spaces, returns the position after what it parsed,
+// or NULL if the text does not match (or s is already NULL)
+
+static const char* parse_reg (const char* s, uint8_t* reg){
+  if (s == NULL) return NULL;
+  while (isspace((unsigned char) *s)) s++;
+  int len = 0;
+  while (isalnum((unsigned char) s[len]) || s[len] == '%') len++;
+
+  for (int r = 0; r < NUM_OF_REGS; r++) {
+    const char* name = get_reg_name(r);
+    if ((int) strlen(name) == len && strncmp(s, name, len) == 0) {
+      *reg = r;
+      return s + len;
+    }
+  }
+  return NULL;
+}
+
+static const char* parse_number (const char* s, uint64_t* val){
+  if (s == NULL) return NULL;
+  while (isspace((unsigned char) *s)) s++;
+  if (!isdigit((unsigned char) *s)) return NULL;
+  char* end;
+  *val = strtoull(s, &end, 0);
+  return end;
+}
+
+// labels are named L followed by the address they stand for in hex
+static const char* parse_label (const char* s, uint64_t* val){
+  if (s == NULL) return NULL;
+  while (isspace((unsigned char) *s)) s++;
+  if (*s != 'L' || !isxdigit((unsigned char) s[1])) return NULL;
+  char* end;
+  *val = strtoull(s + 1, &end, 16);
+  return end;
+}
+
+// c may be '\0' to check that nothing but spaces is left
+static const char* expect_char (const char* s, char c){
+  if (s == NULL) return NULL;
+  while (isspace((unsigned char) *s)) s++;
+  if (*s != c) return NULL;
+  return c == '\0' ? s : s + 1;
+}
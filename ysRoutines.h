@@ -0,0 +1,44 @@
+/* This file contains the prototypes and constants needed to use the
+   reassemblable .ys output routines defined in ysRoutines.c
+*/
+
+#ifndef _YSROUTINES_H_
+#define _YSROUTINES_H_
+
+#include <stdio.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "printRoutines.h"
+
+typedef struct {
+	y86_addr_t* addrs;
+	long num_of_addrs;
+	long capacity;
+} addr_list_t;
+
+typedef struct {
+	// jump and call targets: forward targets wait in a min-heap until their address is
+	// reached, the others get their label defined at the end of the output
+	addr_list_t pending;
+	addr_list_t defined;		// labels placed before an item, in address order
+	addr_list_t trailer;		// labels to define at the end of the output
+	int out_of_memory;
+
+	y86_addr_t expected_addr;	// address right after the previously emitted item, or INVALID_ADDR
+
+	// round-trip verification
+	y86_addr_t location;		// location counter of the assembler reading the output
+	long bytes_verified;
+	long num_of_mismatches;
+	y86_addr_t first_mismatch;
+} ys_writer_t;
+
+void init_ys_writer (ys_writer_t* ys);
+void ys_emit (ys_writer_t* ys, inst_t inst, y86_addr_t currAddr, FILE* out);
+int ys_end_emitting (ys_writer_t* ys, FILE* out);
+void free_ys_writer (ys_writer_t* ys);
+
+
+#endif /* YSROUTINES */